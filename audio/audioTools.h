@@ -0,0 +1,1432 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <typeindex>
+#include <vector>
+
+#include "al/io/al_AudioIOData.hpp"
+#include "al/scene/al_PolySynth.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define AUDIO_SIMD_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define AUDIO_SIMD_NEON
+#endif
+
+/*------------------------------------------------------------
+
+    Block processing helpers for allolib voices
+
+    Voices render a whole block at a time: each unit generator
+    fills a scratch buffer, then the buffers are combined and
+    accumulated into the output with vectorized loops instead
+    of one io.out() call per sample.
+
+------------------------------------------------------------*/
+namespace audio
+{
+    // Frames rendered per chunk (larger blocks are split)
+    constexpr static int maxBlock = 1024;
+    constexpr static int numScratch = 8;
+
+    // returns scratch buffer k for the calling thread (contents are not preserved between voices)
+    inline float* scratch(int k){
+        alignas(16) static thread_local float buffers[numScratch][maxBlock];
+        return buffers[k];
+    }
+
+// ------------------------------------------------------------------
+//      4-wide float vectors (SSE / NEON / scalar fallback)
+// ------------------------------------------------------------------
+    namespace simd
+    {
+#if defined(AUDIO_SIMD_SSE)
+        using f4 = __m128;
+        constexpr static int width = 4;
+        inline f4 load(const float* p){ return _mm_loadu_ps(p); }
+        inline void store(float* p, f4 v){ _mm_storeu_ps(p, v); }
+        inline f4 splat(float x){ return _mm_set1_ps(x); }
+        inline f4 add(f4 a, f4 b){ return _mm_add_ps(a, b); }
+        inline f4 mul(f4 a, f4 b){ return _mm_mul_ps(a, b); }
+        inline f4 max(f4 a, f4 b){ return _mm_max_ps(a, b); }
+        inline f4 abs(f4 a){ return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+#elif defined(AUDIO_SIMD_NEON)
+        using f4 = float32x4_t;
+        constexpr static int width = 4;
+        inline f4 load(const float* p){ return vld1q_f32(p); }
+        inline void store(float* p, f4 v){ vst1q_f32(p, v); }
+        inline f4 splat(float x){ return vdupq_n_f32(x); }
+        inline f4 add(f4 a, f4 b){ return vaddq_f32(a, b); }
+        inline f4 mul(f4 a, f4 b){ return vmulq_f32(a, b); }
+        inline f4 max(f4 a, f4 b){ return vmaxq_f32(a, b); }
+        inline f4 abs(f4 a){ return vabsq_f32(a); }
+#else
+        struct f4 { float x; };
+        constexpr static int width = 1;
+        inline f4 load(const float* p){ return {*p}; }
+        inline void store(float* p, f4 v){ *p = v.x; }
+        inline f4 splat(float x){ return {x}; }
+        inline f4 add(f4 a, f4 b){ return {a.x + b.x}; }
+        inline f4 mul(f4 a, f4 b){ return {a.x * b.x}; }
+        inline f4 max(f4 a, f4 b){ return {std::max(a.x, b.x)}; }
+        inline f4 abs(f4 a){ return {std::abs(a.x)}; }
+#endif
+    }
+
+// ------------------------------------------------------------------
+//      Block operations
+// ------------------------------------------------------------------
+
+    // dst[i] *= src[i]
+    inline void mul(float* dst, const float* src, int n){
+        int i = 0;
+        for(; i + simd::width <= n; i += simd::width)
+            simd::store(dst+i, simd::mul(simd::load(dst+i), simd::load(src+i)));
+        for(; i < n; ++i) dst[i] *= src[i];
+    }
+
+    // dst[i] *= gain
+    inline void scale(float* dst, float gain, int n){
+        int i = 0;
+        simd::f4 g = simd::splat(gain);
+        for(; i + simd::width <= n; i += simd::width)
+            simd::store(dst+i, simd::mul(simd::load(dst+i), g));
+        for(; i < n; ++i) dst[i] *= gain;
+    }
+
+    // dst[i] += src[i]
+    inline void add(float* dst, const float* src, int n){
+        int i = 0;
+        for(; i + simd::width <= n; i += simd::width)
+            simd::store(dst+i, simd::add(simd::load(dst+i), simd::load(src+i)));
+        for(; i < n; ++i) dst[i] += src[i];
+    }
+
+    // dst[i] += src[i] * gain
+    inline void addScaled(float* dst, const float* src, float gain, int n){
+        int i = 0;
+        simd::f4 g = simd::splat(gain);
+        for(; i + simd::width <= n; i += simd::width)
+            simd::store(dst+i, simd::add(simd::load(dst+i), simd::mul(simd::load(src+i), g)));
+        for(; i < n; ++i) dst[i] += src[i] * gain;
+    }
+
+    // left[i] += src[i] * gainL, right[i] += src[i] * gainR (one pass over src)
+    inline void panAdd(float* left, float* right, const float* src, float gainL, float gainR, int n){
+        int i = 0;
+        simd::f4 gl = simd::splat(gainL);
+        simd::f4 gr = simd::splat(gainR);
+        for(; i + simd::width <= n; i += simd::width){
+            simd::f4 s = simd::load(src+i);
+            simd::store(left+i, simd::add(simd::load(left+i), simd::mul(s, gl)));
+            simd::store(right+i, simd::add(simd::load(right+i), simd::mul(s, gr)));
+        }
+        for(; i < n; ++i){
+            left[i] += src[i] * gainL;
+            right[i] += src[i] * gainR;
+        }
+    }
+
+    // dst[i] = value
+    inline void fill(float* dst, float value, int n){
+        int i = 0;
+        simd::f4 v = simd::splat(value);
+        for(; i + simd::width <= n; i += simd::width)
+            simd::store(dst+i, v);
+        for(; i < n; ++i) dst[i] = value;
+    }
+
+    // dst[i] = start + step * i
+    inline void ramp(float* dst, float start, float step, int n){
+        int i = 0;
+        if(n >= simd::width){
+            float lanes[simd::width];
+            for(int k = 0; k < simd::width; ++k) lanes[k] = (float)k;
+            simd::f4 index = simd::load(lanes);
+            simd::f4 s = simd::splat(start), d = simd::splat(step), w = simd::splat(simd::width);
+            for(; i + simd::width <= n; i += simd::width){
+                simd::store(dst+i, simd::add(s, simd::mul(d, index)));
+                index = simd::add(index, w);
+            }
+        }
+        for(; i < n; ++i) dst[i] = start + step * i;
+    }
+
+    // returns the largest absolute sample in src
+    inline float peak(const float* src, int n){
+        int i = 0;
+        float result = 0;
+        if(n >= simd::width){
+            simd::f4 m = simd::splat(0);
+            for(; i + simd::width <= n; i += simd::width)
+                m = simd::max(m, simd::abs(simd::load(src+i)));
+            float lanes[simd::width];
+            simd::store(lanes, m);
+            for(float x : lanes) result = std::max(result, x);
+        }
+        for(; i < n; ++i) result = std::max(result, std::abs(src[i]));
+        return result;
+    }
+
+    // Fills dst with n successive outputs of a unit generator
+    template<class Gen>
+    inline void generate(float* dst, Gen& gen, int n){
+        for(int i = 0; i < n; ++i) dst[i] = gen();
+    }
+
+    /*
+        Runs fn(frame, n) over the frames left in io's current block,
+        in chunks of at most maxBlock frames.
+
+        PolySynth positions the frame iterator at a voice's start offset
+        before onProcess, so rendering starts there. The iterator is left
+        at the end of the block, as a while(io()) loop would leave it.
+    */
+    template<class Fn>
+    inline void forEachChunk(al::AudioIOData& io, Fn&& fn){
+        int frames = (int)io.framesPerBuffer();
+        int frame = std::max(io.frame() + 1, 0);
+        while(frame < frames){
+            int n = std::min(maxBlock, frames - frame);
+            fn(frame, n);
+            frame += n;
+        }
+        io.frame(frames);
+    }
+
+    /*
+        As above, but no chunk straddles splitFrame: split() runs once
+        before the frame at splitFrame is rendered (before the first
+        chunk when the voice starts at or after it). A splitFrame at or
+        past the end of the block never splits.
+    */
+    template<class Split, class Fn>
+    inline void forEachChunk(al::AudioIOData& io, int splitFrame, Split&& split, Fn&& fn){
+        int frames = (int)io.framesPerBuffer();
+        int frame = std::max(io.frame() + 1, 0);
+        bool due = splitFrame < frames;
+        while(frame < frames){
+            if(due && splitFrame <= frame){
+                split();
+                due = false;
+            }
+            int end = std::min(frame + maxBlock, frames);
+            if(due) end = std::min(end, splitFrame);
+            fn(frame, end - frame);
+            frame = end;
+        }
+        io.frame(frames);
+    }
+
+    /*
+        Sample-accurate note-off. SynthVoice::triggerOff(offset) calls
+        onTriggerOff() straight away, at the top of the block. A voice that
+        only arm()s its ReleasePoint there, then releases from onProcess at
+        frame(), releases on the frame the note-off was scheduled for:
+
+            audio::forEachChunk(io, mRelease.frame(*this, io),
+                                [&]{ mAmpEnv.release(); },
+                                [&](int frame, int n){ ... });
+    */
+    class ReleasePoint {
+        public:
+            void arm(){ mPending = true; }
+            void clear(){ mPending = false; }   // call from onTriggerOn
+            bool pending() const { return mPending; }
+
+            // returns the frame in io's block to release at, framesPerBuffer when none is due
+            int frame(al::SynthVoice& voice, const al::AudioIOData& io){
+                int frames = (int)io.framesPerBuffer();
+                if(!mPending) return frames;
+                int offset = voice.getEndOffsetFrames(frames);
+                if(offset >= frames) return frames;     // falls in a later block
+                mPending = false;
+                return offset;
+            }
+
+        private:
+            bool mPending = false;
+    };
+
+// ------------------------------------------------------------------
+//      Voice completion
+// ------------------------------------------------------------------
+
+    /*
+        Tail detector for voices whose generators have no done():
+        the voice is silent once its output has stayed below
+        threshold for holdFrames frames.
+    */
+    class SilenceDetector {
+        public:
+            float threshold = 1e-4f;    // -80 dB
+            int holdFrames = 512;
+
+            void reset(){ mQuietFrames = 0; }
+
+            // feed the samples the voice rendered this block
+            void update(const float* src, int n){
+                if(peak(src, n) < threshold) mQuietFrames += n;
+                else mQuietFrames = 0;
+            }
+
+            bool silent() const { return mQuietFrames >= holdFrames; }
+
+        private:
+            int mQuietFrames = 0;
+    };
+
+    // Voice counts, written on the audio thread and readable from any thread
+    struct voice_stats {
+        std::atomic<int> allocated{0};      // voice objects, kept up to date by the owner (preallocated included)
+        std::atomic<int> active{0};
+        std::atomic<uint64_t> completed{0};
+
+        int available() const { return allocated - active; }
+    };
+
+// ------------------------------------------------------------------
+//      Voice pools
+// ------------------------------------------------------------------
+
+    enum class steal_policy { oldest, quietest, same_note };
+
+    /*
+        Bounded polyphony for one voice type. Voices register when they
+        start and leave when they finish (audio thread). Once maxVoices
+        are sounding, a starting voice picks a victim by policy and calls
+        victim->steal(), which should fade the victim out and free it.
+
+        The slot table is sized by reserve() and never grows, so nothing
+        here allocates on the audio thread. A pool that was never
+        reserved does not limit polyphony.
+    */
+    template<class Voice>
+    class VoicePool {
+        public:
+            steal_policy policy = steal_policy::oldest;
+
+            // call before audio starts
+            void reserve(int maxVoices, steal_policy p = steal_policy::oldest){
+                mSlots.clear();
+                mSlots.reserve(maxVoices);
+                mMax = maxVoices;
+                policy = p;
+            }
+
+            int capacity() const { return mMax; }
+            int active() const { return mActive; }
+            uint64_t stolen() const { return mStolen; }
+
+            void start(Voice* voice, int note){
+                if(mMax == 0) return;
+                int i = find(voice);
+                if(i >= 0){
+                    mSlots[i] = {voice, mOrder++, 1.f, note};
+                    return;
+                }
+                if((int)mSlots.size() >= mMax){
+                    int victim = pickVictim(note);
+                    mSlots[victim].voice->steal();
+                    remove(victim);
+                    mStolen++;
+                }
+                mSlots.push_back({voice, mOrder++, 1.f, note});
+                mActive = (int)mSlots.size();
+            }
+
+            void stop(Voice* voice){
+                int i = find(voice);
+                if(i >= 0) remove(i);
+            }
+
+            // latest block peak, used by the quietest policy
+            void level(Voice* voice, float peak){
+                int i = find(voice);
+                if(i >= 0) mSlots[i].level = peak;
+            }
+
+        private:
+            struct slot {
+                Voice* voice;
+                uint64_t order;
+                float level;
+                int note;
+            };
+
+            int find(Voice* voice) const {
+                for(int i = 0; i < (int)mSlots.size(); ++i)
+                    if(mSlots[i].voice == voice) return i;
+                return -1;
+            }
+
+            void remove(int i){
+                mSlots[i] = mSlots.back();
+                mSlots.pop_back();
+                mActive = (int)mSlots.size();
+            }
+
+            // true if a is a better victim than b
+            bool before(const slot& a, const slot& b, int note) const {
+                switch(policy){
+                    case steal_policy::quietest:
+                        return a.level < b.level || (a.level == b.level && a.order < b.order);
+                    case steal_policy::same_note:
+                        if((a.note == note) != (b.note == note)) return a.note == note;
+                        return a.order < b.order;
+                    default:
+                        return a.order < b.order;
+                }
+            }
+
+            int pickVictim(int note) const {
+                int victim = 0;
+                for(int i = 1; i < (int)mSlots.size(); ++i)
+                    if(before(mSlots[i], mSlots[victim], note)) victim = i;
+                return victim;
+            }
+
+            std::vector<slot> mSlots;
+            int mMax = 0;
+            uint64_t mOrder = 0;
+            std::atomic<int> mActive{0};
+            std::atomic<uint64_t> mStolen{0};
+    };
+
+// ------------------------------------------------------------------
+//      Effect send bus
+// ------------------------------------------------------------------
+
+    /*
+        Mono bus that voices mix a send level into while they render.
+        The owner runs a single effect over the summed bus once per
+        block, so effect memory and cost do not grow with voice count.
+    */
+    class SendBus {
+        public:
+            // allocate once, outside the audio callback
+            void resize(int frames){ mBuffer.assign(frames, 0.f); }
+            int size() const { return (int)mBuffer.size(); }
+            const float* data() const { return mBuffer.data(); }
+            void clear(){ std::fill(mBuffer.begin(), mBuffer.end(), 0.f); }
+
+            // bus[frame + i] += src[i] * gain
+            void send(int frame, const float* src, float gain, int n){
+                n = std::min(n, size() - frame);
+                if(n > 0) addScaled(mBuffer.data() + frame, src, gain, n);
+            }
+
+            // runs fx over the bus, adds the return to both outputs and clears the bus
+            template<class Effect>
+            void process(al::AudioIOData& io, Effect& fx, float gainL = 1, float gainR = 1){
+                int frames = std::min((int)io.framesPerBuffer(), size());
+                float* bus = mBuffer.data();
+                for(int i = 0; i < frames; ++i) bus[i] = fx(bus[i]);
+                panAdd(io.outBuffer(0), io.outBuffer(1), bus, gainL, gainR, frames);
+                std::fill(bus, bus + frames, 0.f);
+            }
+
+        private:
+            std::vector<float> mBuffer;
+    };
+
+// ------------------------------------------------------------------
+//      Pre-rendered one-shots
+// ------------------------------------------------------------------
+
+    // Rendered voice output: stereo plus the signal the voice sent to its bus
+    struct clip {
+        std::vector<float> left, right, send;
+        int frames() const { return (int)left.size(); }
+        size_t bytes() const { return (left.size() + right.size() + send.size()) * sizeof(float); }
+    };
+
+    // Trigger parameters stored inline, so building a key does not allocate
+    struct trigger_params {
+        constexpr static int maxParams = 8;
+        float values[maxParams] = {};
+        int count = 0;
+
+        trigger_params() = default;
+        trigger_params(std::initializer_list<float> list){
+            for(float v : list) if(count < maxParams) values[count++] = v;
+        }
+
+        bool empty() const { return count == 0; }
+        bool operator==(const trigger_params& other) const {
+            return count == other.count && std::equal(values, values + count, other.values);
+        }
+    };
+
+    struct clip_key {
+        std::type_index type;
+        trigger_params params;
+        float duration;
+        double sampleRate;
+
+        bool operator==(const clip_key& other) const {
+            return type == other.type && params == other.params &&
+                   duration == other.duration && sampleRate == other.sampleRate;
+        }
+    };
+
+    /*
+        Renders a voice offline: triggers it, releases it after duration
+        seconds and stops once the voice frees itself (or after maxSeconds).
+        If the voice sends to bus, the send is captured into clip.send.
+        Trailing silence is trimmed.
+    */
+    template<class Voice>
+    clip renderVoice(Voice& voice, float duration, double sampleRate,
+                     SendBus* bus = nullptr, float maxSeconds = 4){
+        constexpr int block = 256;
+        clip out;
+        al::AudioIOData io;
+        io.framesPerSecond(sampleRate);
+        io.channelsOut(2);
+
+        int releaseFrame = std::max(0, (int)std::lround(duration * sampleRate));
+        int maxFrames = (int)(maxSeconds * sampleRate);
+        bool released = false;
+
+        voice.triggerOn();
+        for(int frame = 0; frame < maxFrames && voice.active(); ){
+            if(!released && frame >= releaseFrame){
+                voice.triggerOff();
+                released = true;
+            }
+            // end the block on the release frame so the release is sample accurate
+            int n = released ? block : std::min(block, releaseFrame - frame);
+            if((int)io.framesPerBuffer() != n) io.framesPerBuffer(n);
+            if(bus && bus->size() < n) bus->resize(n);
+
+            io.zeroOut();
+            io.frame(0);
+            voice.onProcess(io);
+
+            out.left.insert(out.left.end(), io.outBuffer(0), io.outBuffer(0) + n);
+            out.right.insert(out.right.end(), io.outBuffer(1), io.outBuffer(1) + n);
+            if(bus){
+                out.send.insert(out.send.end(), bus->data(), bus->data() + n);
+                bus->clear();
+            }
+            frame += n;
+        }
+
+        int end = out.frames();
+        auto audible = [&](int i){
+            constexpr float floor = 1e-5f; // -100 dB
+            return std::abs(out.left[i]) > floor || std::abs(out.right[i]) > floor ||
+                   (!out.send.empty() && std::abs(out.send[i]) > floor);
+        };
+        while(end > 0 && !audible(end - 1)) --end;
+        out.left.resize(end);
+        out.right.resize(end);
+        out.send.resize(std::min(end, (int)out.send.size()));
+
+        // voices that never sent anything do not need a send channel
+        if(std::all_of(out.send.begin(), out.send.end(), [](float x){ return x == 0.f; }))
+            out.send.clear();
+        return out;
+    }
+
+    /*
+        Least-recently-used cache of rendered clips, bounded in bytes.
+        Clips are shared: a voice that is still playing an evicted clip
+        keeps it alive until the voice drops its reference.
+    */
+    class ClipCache {
+        public:
+            bool enabled = false;   // opt in: a miss renders the clip on the calling thread
+
+            ClipCache(size_t capacityBytes = 32 << 20) : mCapacity(capacityBytes) {}
+
+            // returns the cached clip for key (and marks it recently used), or nullptr
+            std::shared_ptr<const clip> find(const clip_key& key){
+                for(auto it = mEntries.begin(); it != mEntries.end(); ++it){
+                    if(it->key == key){
+                        mEntries.splice(mEntries.begin(), mEntries, it);
+                        return it->data;
+                    }
+                }
+                return nullptr;
+            }
+
+            std::shared_ptr<const clip> insert(const clip_key& key, clip c){
+                auto data = std::make_shared<const clip>(std::move(c));
+                mEntries.push_front({key, data});
+                mBytes += data->bytes();
+                while(mBytes > mCapacity && mEntries.size() > 1){
+                    mBytes -= mEntries.back().data->bytes();
+                    mEntries.pop_back();
+                }
+                return data;
+            }
+
+            void clear(){ mEntries.clear(); mBytes = 0; }
+            size_t bytes() const { return mBytes; }
+            size_t size() const { return mEntries.size(); }
+
+        private:
+            struct entry {
+                clip_key key;
+                std::shared_ptr<const clip> data;
+            };
+            std::list<entry> mEntries;
+            size_t mBytes = 0;
+            size_t mCapacity;
+    };
+
+// ------------------------------------------------------------------
+//      Offline rendering
+// ------------------------------------------------------------------
+
+    struct render_settings {
+        double seconds = 10;
+        double sampleRate = 48000;
+        int blockSize = 512;
+        int channels = 2;
+    };
+
+    /*
+        Runs an audio graph without an audio device, as fast as the CPU
+        allows. renderBlock(io) is called once per block (usually the
+        app's onSound) and the output is returned interleaved. The
+        graph only sees io, so the result is the same on every run as
+        long as the graph is deterministic: Gamma seeds noise from a
+        global, so voices with noise should seed it when they trigger
+        (the drum demo counts hits from setupAudio). Prints the render
+        speed as a multiple of realtime.
+    */
+    template<class Fn>
+    std::vector<float> renderOffline(const render_settings& settings, Fn&& renderBlock){
+        al::AudioIOData io;
+        io.framesPerSecond(settings.sampleRate);
+        io.framesPerBuffer(settings.blockSize);
+        io.channelsOut(settings.channels);
+
+        long total = std::lround(settings.seconds * settings.sampleRate);
+        std::vector<float> out;
+        out.reserve(total * settings.channels);
+
+        auto begin = std::chrono::steady_clock::now();
+        for(long frame = 0; frame < total; frame += settings.blockSize){
+            io.zeroOut();
+            io.frame(0);
+            renderBlock(io);
+
+            int n = (int)std::min<long>(settings.blockSize, total - frame);
+            for(int i = 0; i < n; ++i)
+                for(int c = 0; c < settings.channels; ++c)
+                    out.push_back(io.outBuffer(c)[i]);
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        printf("rendered %.2f s of audio in %.3f s (%.1fx realtime)\n",
+               settings.seconds, elapsed, settings.seconds / std::max(elapsed, 1e-9));
+        return out;
+    }
+
+    // Writes interleaved samples as a 32-bit float WAV file. returns false if the file can't be written
+    inline bool writeWav(const std::string& path, const std::vector<float>& samples,
+                         int channels, double sampleRate){
+        FILE* file = fopen(path.c_str(), "wb");
+        if(!file) return false;
+
+        auto u32 = [&](uint32_t v){ uint8_t b[4] = {uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24)}; fwrite(b, 1, 4, file); };
+        auto u16 = [&](uint16_t v){ uint8_t b[2] = {uint8_t(v), uint8_t(v >> 8)}; fwrite(b, 1, 2, file); };
+
+        uint32_t rate = (uint32_t)sampleRate;
+        uint32_t dataBytes = (uint32_t)(samples.size() * 4);
+        fwrite("RIFF", 1, 4, file); u32(36 + dataBytes);
+        fwrite("WAVE", 1, 4, file);
+        fwrite("fmt ", 1, 4, file); u32(16);
+        u16(3);                         // IEEE float
+        u16(channels);
+        u32(rate);
+        u32(rate * channels * 4);       // bytes per second
+        u16(channels * 4);              // bytes per frame
+        u16(32);
+        fwrite("data", 1, 4, file); u32(dataBytes);
+        for(float x : samples){
+            uint32_t bits;
+            memcpy(&bits, &x, 4);
+            u32(bits);
+        }
+        return fclose(file) == 0;
+    }
+
+// ------------------------------------------------------------------
+//      Step patterns
+//          {kick, "x.......x.x....."} -> hits at beats 0, 2, 2.5
+// ------------------------------------------------------------------
+
+    struct step_lane {
+        uint8_t voice;              // instrument id, meaning is up to the caller
+        std::string_view steps;     // one char per step across the bar: 'x' or 'X' hit, anything else rest
+        float param = 0;            // passed through to every hit (e.g. kick pitch)
+    };
+
+    struct step_event {
+        float beat;
+        uint8_t voice;
+        float param;
+    };
+
+    // A bar of hits sorted by beat, built at compile time by makeGroove
+    struct groove {
+        constexpr static int maxEvents = 128;
+        step_event events[maxEvents] = {};
+        int count = 0;
+        float beats = 4;
+
+        constexpr const step_event* begin() const { return events; }
+        constexpr const step_event* end() const { return events + count; }
+    };
+
+    /*
+        Compiles step lanes into one sorted event list. Each lane spreads
+        its steps evenly over the bar, so lanes can use different
+        resolutions (16 steps = sixteenths, 32 = thirty-seconds in 4/4).
+        Hits on the same beat keep lane order.
+    */
+    constexpr groove makeGroove(std::initializer_list<step_lane> lanes, float beats = 4){
+        groove g;
+        g.beats = beats;
+        for(const step_lane& lane : lanes){
+            for(size_t i = 0; i < lane.steps.size(); ++i){
+                if(lane.steps[i] != 'x' && lane.steps[i] != 'X') continue;
+                if(g.count == groove::maxEvents) throw std::out_of_range("makeGroove : too many hits in one bar");
+
+                step_event e{beats * i / lane.steps.size(), lane.voice, lane.param};
+                int j = g.count++;
+                for(; j > 0 && g.events[j-1].beat > e.beat; --j) g.events[j] = g.events[j-1];
+                g.events[j] = e;
+            }
+        }
+        return g;
+    }
+
+    /*
+        returns the time in seconds of a beat at tempo (bpm). swing delays
+        every second swingUnit (eighths by default) by that fraction of a
+        unit: 0 is straight, 1/3 is a triplet shuffle.
+    */
+    constexpr float grooveTime(float beat, float tempo, float swing = 0, float swingUnit = 0.5){
+        float units = beat / swingUnit;
+        int whole = (int)units;
+        if(swing != 0 && units == whole && whole % 2 == 1) beat += swing * swingUnit;
+        return beat * 60 / tempo;
+    }
+
+// ------------------------------------------------------------------
+//      Lock-free queue
+// ------------------------------------------------------------------
+
+    /*
+        Wait-free single-producer / single-consumer ring buffer. One thread
+        pushes, one other thread pops; neither ever blocks or allocates.
+        Capacity is rounded up to a power of two.
+    */
+    template<class T>
+    class SpscQueue {
+        public:
+            explicit SpscQueue(size_t capacity){
+                size_t size = 1;
+                while(size < capacity) size <<= 1;
+                mItems.resize(size);
+                mMask = size - 1;
+            }
+
+            size_t capacity() const { return mItems.size(); }
+
+            // producer: returns false if the queue is full
+            bool push(const T& item){
+                size_t tail = mTail.load(std::memory_order_relaxed);
+                if(tail - mHead.load(std::memory_order_acquire) == mItems.size()) return false;
+                mItems[tail & mMask] = item;
+                mTail.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+
+            // consumer: returns false if the queue is empty
+            bool pop(T& item){
+                size_t head = mHead.load(std::memory_order_relaxed);
+                if(head == mTail.load(std::memory_order_acquire)) return false;
+                item = mItems[head & mMask];
+                mHead.store(head + 1, std::memory_order_release);
+                return true;
+            }
+
+            // producer: pushes up to count items, returns how many fit
+            size_t push(const T* items, size_t count){
+                size_t tail = mTail.load(std::memory_order_relaxed);
+                count = std::min(count, mItems.size() - (tail - mHead.load(std::memory_order_acquire)));
+                for(size_t i = 0; i < count; ++i) mItems[(tail + i) & mMask] = items[i];
+                mTail.store(tail + count, std::memory_order_release);
+                return count;
+            }
+
+            // consumer: pops up to count items, returns how many there were
+            size_t pop(T* items, size_t count){
+                size_t head = mHead.load(std::memory_order_relaxed);
+                count = std::min(count, mTail.load(std::memory_order_acquire) - head);
+                for(size_t i = 0; i < count; ++i) items[i] = mItems[(head + i) & mMask];
+                mHead.store(head + count, std::memory_order_release);
+                return count;
+            }
+
+            // consumer: returns the next item without removing it, or nullptr
+            const T* peek() const {
+                size_t head = mHead.load(std::memory_order_relaxed);
+                if(head == mTail.load(std::memory_order_acquire)) return nullptr;
+                return &mItems[head & mMask];
+            }
+
+        private:
+            std::vector<T> mItems;
+            size_t mMask;
+            alignas(64) std::atomic<size_t> mHead{0};   // written by the consumer
+            alignas(64) std::atomic<size_t> mTail{0};   // written by the producer
+    };
+
+// ------------------------------------------------------------------
+//      Event scheduling
+// ------------------------------------------------------------------
+
+    // A voice to start `start` seconds after submission, released `duration` seconds later
+    struct note_event {
+        al::SynthVoice* voice;
+        double start;
+        double duration;
+    };
+
+    // Timing counters, written on the audio thread and readable from any thread
+    struct scheduler_stats {
+        std::atomic<uint64_t> started{0};
+        std::atomic<uint64_t> late{0};          // started after their frame had already played
+        std::atomic<int> maxLateFrames{0};      // worst lateness (jitter) seen
+        std::atomic<uint64_t> dropped{0};       // rejected because the queue was full
+    };
+
+    /*
+        Replacement for SynthSequencer::addVoiceFromNow(). submit() sorts a
+        batch once and hands it to the audio thread through a lock-free
+        queue, so key handlers never take a lock the audio thread needs.
+        render() runs at the top of onSound: it drains the queue into a
+        preallocated heap, starts each due voice at its frame offset
+        within the block and releases it with triggerOff(offset); voices
+        that use a ReleasePoint release on that frame.
+    */
+    class EventScheduler {
+        public:
+            scheduler_stats stats;
+
+            EventScheduler(size_t capacity = 16384) : mIncoming(capacity) {
+                mPending.reserve(mIncoming.capacity());
+                mPlaying.reserve(mIncoming.capacity());
+                mBatch.reserve(mIncoming.capacity());
+                mSorted.reserve(mIncoming.capacity());
+            }
+
+            // seconds rendered so far
+            double time() const { return mTime; }
+
+            // submitting thread: returns the number of events that did not fit
+            // batches of up to capacity events do not allocate
+            size_t submit(const note_event* events, size_t count){
+                double now = mTime;
+                mBatch.clear();
+                for(size_t i = 0; i < count; ++i){
+                    double start = now + events[i].start;
+                    mBatch.push_back({start, start + events[i].duration, events[i].voice});
+                }
+
+                // stable merge sort between the two reserved buffers (std::stable_sort
+                // allocates its own), so equal starts keep their submission order
+                size_t n = mBatch.size();
+                mSorted.resize(n);
+                timed* from = mBatch.data();
+                timed* to = mSorted.data();
+                for(size_t width = 1; width < n; width *= 2){
+                    for(size_t lo = 0; lo < n; lo += 2*width){
+                        size_t mid = std::min(lo + width, n), hi = std::min(lo + 2*width, n);
+                        std::merge(from + lo, from + mid, from + mid, from + hi, to + lo, earlier);
+                    }
+                    std::swap(from, to);
+                }
+
+                size_t pushed = 0;
+                while(pushed < n && mIncoming.push(from[pushed])) ++pushed;
+                stats.dropped += n - pushed;
+                return n - pushed;
+            }
+
+            size_t submit(const std::vector<note_event>& events){ return submit(events.data(), events.size()); }
+
+            // audio thread: starts and releases the voices due before the end of this block,
+            // each at its frame offset in the block
+            void render(al::AudioIOData& io, al::PolySynth& synth){
+                double rate = io.framesPerSecond();
+                double blockStart = mTime;
+                double blockEnd = blockStart + io.framesPerBuffer() / rate;
+
+                // heap space is reserved up front; whatever does not fit waits in the queue
+                timed e;
+                while(mPending.size() < mPending.capacity() && mIncoming.pop(e)){
+                    mPending.push_back(e);
+                    std::push_heap(mPending.begin(), mPending.end(), later);
+                }
+
+                while(!mPending.empty() && mPending.front().start < blockEnd){
+                    std::pop_heap(mPending.begin(), mPending.end(), later);
+                    e = mPending.back();
+                    mPending.pop_back();
+
+                    int offset = (int)std::lround((e.start - blockStart) * rate);
+                    if(offset < 0){
+                        stats.late++;
+                        if(-offset > stats.maxLateFrames) stats.maxLateFrames = -offset;
+                        offset = 0;
+                    }
+                    offset = std::min(offset, (int)io.framesPerBuffer() - 1);
+
+                    forget(e.voice);    // a recycled voice must not get its old release
+                    synth.triggerOn(e.voice, offset);
+                    if(mPlaying.size() < mPlaying.capacity()) mPlaying.push_back(e);
+                    stats.started++;
+                }
+
+                for(size_t i = 0; i < mPlaying.size(); ){
+                    if(mPlaying[i].end < blockEnd){
+                        int offset = (int)std::lround((mPlaying[i].end - blockStart) * rate);
+                        offset = std::max(0, std::min(offset, (int)io.framesPerBuffer() - 1));
+                        mPlaying[i].voice->triggerOff(offset);
+                        mPlaying[i] = mPlaying.back();
+                        mPlaying.pop_back();
+                    }
+                    else ++i;
+                }
+                mTime = blockEnd;
+            }
+
+        private:
+            struct timed {
+                double start;
+                double end;
+                al::SynthVoice* voice;
+            };
+
+            static bool earlier(const timed& a, const timed& b){ return a.start < b.start; }
+
+            // heap order: earliest start on top
+            static bool later(const timed& a, const timed& b){ return a.start > b.start; }
+
+            void forget(al::SynthVoice* voice){
+                for(size_t i = 0; i < mPlaying.size(); ++i){
+                    if(mPlaying[i].voice == voice){
+                        mPlaying[i] = mPlaying.back();
+                        mPlaying.pop_back();
+                        return;
+                    }
+                }
+            }
+
+            std::vector<timed> mBatch;      // submitting thread only
+            std::vector<timed> mSorted;     // submitting thread only, merge sort buffer
+            SpscQueue<timed> mIncoming;
+            std::vector<timed> mPending;    // audio thread only, min-heap on start
+            std::vector<timed> mPlaying;    // audio thread only
+            std::atomic<double> mTime{0};
+    };
+
+    /*
+        Measures how long each audio callback takes against the length of
+        its block. A callback that takes longer than its block is an
+        overrun, i.e. an audible dropout.
+    */
+    class CallbackMonitor {
+        public:
+            std::atomic<uint64_t> blocks{0};
+            std::atomic<uint64_t> overruns{0};
+            std::atomic<float> peakLoad{0};     // worst callback time / block length
+
+            void begin(){ mStart = std::chrono::steady_clock::now(); }
+
+            void end(const al::AudioIOData& io){
+                double used = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+                float load = (float)(used * io.framesPerSecond() / io.framesPerBuffer());
+                blocks++;
+                if(load > 1) overruns++;
+                if(load > peakLoad) peakLoad = load;
+            }
+
+        private:
+            std::chrono::steady_clock::time_point mStart;
+    };
+
+// ------------------------------------------------------------------
+//      Band-limited wavetables
+// ------------------------------------------------------------------
+
+    /*
+        Mip-mapped single-cycle tables, one per octave. An octave's table
+        only holds the harmonics that stay below Nyquist at the top of
+        that octave, so reading it anywhere in the octave cannot alias.
+        Built once, then shared read-only by every voice.
+    */
+    class WavetableBank {
+        public:
+            constexpr static int tableBits = 11;
+            constexpr static int tableSize = 1 << tableBits;   // samples per cycle
+            constexpr static int numOctaves = 11;              // 20 Hz .. 20 kHz
+
+            // harmonic(k) returns the amplitude of harmonic k = 1 .. maxHarmonic
+            template<class Fn>
+            WavetableBank(double sampleRate, int maxHarmonic, Fn&& harmonic, float baseFreq = 20)
+                : mTables(numOctaves * (tableSize + 1)), mSampleRate(sampleRate), mBase(baseFreq)
+            {
+                const double pi = 3.14159265358979323846;
+                for(int octave = 0; octave < numOctaves; ++octave){
+                    double top = baseFreq * std::pow(2.0, octave);
+                    float* table = &mTables[octave * (tableSize + 1)];
+                    for(int k = 1; k <= maxHarmonic && k * top < sampleRate / 2; ++k){
+                        float amp = harmonic(k);
+                        if(amp == 0) continue;
+                        for(int i = 0; i < tableSize; ++i)
+                            table[i] += amp * (float)std::sin(2 * pi * k * i / tableSize);
+                    }
+                    table[tableSize] = table[0];    // guard point for interpolation
+                }
+            }
+
+            double sampleRate() const { return mSampleRate; }
+
+            // returns the table to read at freq: the lowest octave whose top is at or above it
+            const float* table(float freq) const {
+                int octave = 0;
+                float top = mBase;
+                while(top < freq && octave < numOctaves - 1){
+                    top *= 2;
+                    ++octave;
+                }
+                return &mTables[octave * (tableSize + 1)];
+            }
+
+        private:
+            std::vector<float> mTables;
+            double mSampleRate;
+            float mBase;
+    };
+
+    // Phase-accumulating reader for a WavetableBank, one interpolated lookup per sample
+    class WavetableOsc {
+        public:
+            void bank(const WavetableBank* b){ mBank = b; }
+
+            // picks the table for freq, so call again when the frequency changes
+            void freq(float f){
+                mTable = mBank->table(f);
+                mIncrement = (uint32_t)(f / mBank->sampleRate() * 4294967296.0);
+            }
+
+            void phase(float p){ mPhase = (uint32_t)(p * 4294967296.0); }
+
+            float operator()(){
+                constexpr int fracBits = 32 - WavetableBank::tableBits;
+                uint32_t i = mPhase >> fracBits;
+                float frac = (mPhase & ((1u << fracBits) - 1)) * (1.f / (1u << fracBits));
+                mPhase += mIncrement;
+                return mTable[i] + frac * (mTable[i + 1] - mTable[i]);
+            }
+
+        private:
+            const WavetableBank* mBank = nullptr;
+            const float* mTable = nullptr;
+            uint32_t mPhase = 0;
+            uint32_t mIncrement = 0;
+    };
+
+    /*
+        returns the shared table bank for a square wave made of the odd
+        harmonics up to maxHarmonic at 1/k, one bank per (sampleRate,
+        maxHarmonic). Call it at startup: finding a built bank is
+        lock-free, building one locks and allocates.
+    */
+    inline const WavetableBank& squareBank(double sampleRate, int maxHarmonic = 7){
+        struct entry {
+            double sampleRate;
+            int maxHarmonic;
+            std::unique_ptr<WavetableBank> bank;
+        };
+        constexpr static int maxBanks = 8;
+        static entry banks[maxBanks];
+        static std::atomic<int> count{0};
+        static std::mutex building;
+
+        auto find = [&](int n) -> const WavetableBank* {
+            for(int i = 0; i < n; ++i)
+                if(banks[i].sampleRate == sampleRate && banks[i].maxHarmonic == maxHarmonic)
+                    return banks[i].bank.get();
+            return nullptr;
+        };
+        if(auto* bank = find(count.load(std::memory_order_acquire))) return *bank;
+
+        std::lock_guard<std::mutex> guard(building);
+        int n = count.load(std::memory_order_relaxed);
+        if(auto* bank = find(n)) return *bank;
+        if(n == maxBanks) throw std::out_of_range("squareBank : more than 8 sample rate / harmonic combinations");
+        banks[n] = {sampleRate, maxHarmonic, std::make_unique<WavetableBank>(
+                        sampleRate, maxHarmonic, [](int k){ return k % 2 ? 1.f / k : 0.f; })};
+        count.store(n + 1, std::memory_order_release);
+        return *banks[n].bank;
+    }
+
+// ------------------------------------------------------------------
+//      Envelopes
+// ------------------------------------------------------------------
+
+    /*
+        Linear attack / sustain / release envelope, the shape gam::Env<3>
+        makes with curve(0) and a sustain point. It knows how many frames
+        are left in its segment, so generate() fills a block with one ramp
+        per segment and switches segment on the exact frame. While it
+        sustains (or has finished) its value is constant, so voices can
+        apply value() as a gain instead of generating it.
+    */
+    class LinearEnvelope {
+        public:
+            // starts the attack from 0, reaching 1 after attackSeconds
+            void reset(float attackSeconds, double sampleRate){
+                mValue = 0;
+                start(attacking, 1, attackSeconds * sampleRate);
+            }
+
+            // falls from the current value to 0 over releaseSeconds
+            void release(float releaseSeconds, double sampleRate){
+                if(mStage == finished) return;
+                start(releasing, 0, releaseSeconds * sampleRate);
+            }
+
+            float value() const { return mValue; }
+            bool steady() const { return mStage == sustaining || mStage == finished; }
+            bool done() const { return mStage == finished; }
+
+            // fills dst with the next n values
+            void generate(float* dst, int n){
+                while(n > 0){
+                    if(steady()){
+                        fill(dst, mValue, n);
+                        return;
+                    }
+                    int k = std::min(n, mLength - mPos);
+                    ramp(dst, mStart + mStep * mPos, mStep, k);
+                    mPos += k;
+                    dst += k;
+                    n -= k;
+                    if(mPos == mLength)
+                        next();
+                    else
+                        mValue = mStart + mStep * mPos;
+                }
+            }
+
+        private:
+            enum stage { attacking, sustaining, releasing, finished };
+
+            void start(stage s, float target, double frames){
+                mStage = s;
+                mStart = mValue;
+                mTarget = target;
+                mPos = 0;
+                mLength = (int)std::lround(frames);
+                if(mLength <= 0)
+                    next();
+                else
+                    mStep = (target - mStart) / mLength;
+            }
+
+            void next(){
+                mValue = mTarget;
+                mStage = mStage == attacking ? sustaining : finished;
+            }
+
+            stage mStage = finished;
+            float mValue = 0;
+            float mStart = 0;
+            float mTarget = 0;
+            float mStep = 0;
+            int mPos = 0;
+            int mLength = 0;
+    };
+
+// ------------------------------------------------------------------
+//      Streaming playback
+// ------------------------------------------------------------------
+
+    /*
+        Plays a WAV file (8/16/24/32-bit PCM or 32-bit float) without
+        loading it. open() only parses the header; a background thread
+        then reads the file in chunks into a lock-free ring that the audio
+        thread drains. Memory stays at the ring size however long the
+        file is. Mono files play on both sides, files with more than two
+        channels play their first two. A file at another sample rate is
+        resampled with linear interpolation.
+    */
+    class StreamPlayer {
+        public:
+            std::atomic<bool> loop{false};          // read by the reader thread
+            std::atomic<uint64_t> underruns{0};     // frames the reader did not deliver in time
+
+            // ringFrames: frames buffered ahead of playback
+            explicit StreamPlayer(size_t ringFrames = 1 << 16) : mRingFrames(ringFrames) {}
+            ~StreamPlayer(){ close(); }
+
+            /*
+                returns false if path is not a WAV file this can play.
+                Not while the audio thread is reading from this player.
+            */
+            bool open(const std::string& path, double sampleRate){
+                close();
+                FILE* file = fopen(path.c_str(), "rb");
+                if(!file) return false;
+                if(!readHeader(file)){
+                    fclose(file);
+                    return false;
+                }
+                mFile = file;
+                mStep = mFileRate / sampleRate;
+                mPhase = 2;     // the first read loads two frames to interpolate between
+                mFrom = mTo = {0, 0};
+                mRing = std::make_unique<SpscQueue<stereo_frame>>(mRingFrames);
+                mFinished = false;
+                mStop = false;
+                mReader = std::thread([this]{ stream(); });
+                return true;
+            }
+
+            void close(){
+                mStop = true;
+                if(mReader.joinable()) mReader.join();
+                if(mFile) fclose(mFile);
+                mFile = nullptr;
+                mRing.reset();
+            }
+
+            bool loaded() const { return mRing != nullptr; }
+
+            // true once the whole file has played (never when looping)
+            bool done() const { return mFinished && (!mRing || !mRing->peek()); }
+
+            /*
+                audio thread: writes the next n frames to left and right;
+                returns the frames that came from the file, the rest are
+                silence.
+            */
+            int read(float* left, float* right, int n){
+                if(!mRing){
+                    fill(left, 0, n);
+                    fill(right, 0, n);
+                    return 0;
+                }
+                int got = mStep == 1 ? copy(left, right, n) : resample(left, right, n);
+                if(got < n){
+                    fill(left + got, 0, n - got);
+                    fill(right + got, 0, n - got);
+                    if(!mFinished) underruns += n - got;
+                }
+                return got;
+            }
+
+        private:
+            struct stereo_frame { float left, right; };
+            constexpr static int chunkFrames = 4096;
+
+            int copy(float* left, float* right, int n){
+                stereo_frame frames[256];
+                int got = 0;
+                while(got < n){
+                    int want = std::min(n - got, 256);
+                    int count = (int)mRing->pop(frames, want);
+                    for(int i = 0; i < count; ++i){
+                        left[got + i] = frames[i].left;
+                        right[got + i] = frames[i].right;
+                    }
+                    got += count;
+                    if(count < want) break;
+                }
+                return got;
+            }
+
+            int resample(float* left, float* right, int n){
+                for(int i = 0; i < n; ++i){
+                    for(; mPhase >= 1; mPhase -= 1){
+                        stereo_frame next;
+                        if(!mRing->pop(next)) return i;
+                        mFrom = mTo;
+                        mTo = next;
+                    }
+                    float t = (float)mPhase;
+                    left[i] = mFrom.left + t * (mTo.left - mFrom.left);
+                    right[i] = mFrom.right + t * (mTo.right - mFrom.right);
+                    mPhase += mStep;
+                }
+                return n;
+            }
+
+            static uint32_t le(const uint8_t* b, int bytes){
+                uint32_t v = 0;
+                for(int i = bytes - 1; i >= 0; --i) v = (v << 8) | b[i];
+                return v;
+            }
+
+            // leaves file at the start of the sample data
+            bool readHeader(FILE* file){
+                uint8_t b[16];
+                if(fread(b, 1, 12, file) != 12 || memcmp(b, "RIFF", 4) || memcmp(b + 8, "WAVE", 4))
+                    return false;
+                bool haveFormat = false;
+                while(fread(b, 1, 8, file) == 8){
+                    uint32_t size = le(b + 4, 4);
+                    if(!memcmp(b, "fmt ", 4) && size >= 16){
+                        if(fread(b, 1, 16, file) != 16) return false;
+                        mFormat = le(b, 2);
+                        mChannels = le(b + 2, 2);
+                        mFileRate = le(b + 4, 4);
+                        mBytes = le(b + 14, 2) / 8;
+                        if(mFormat == 0xFFFE && size >= 26){     // extensible: format is in the sub-format GUID
+                            if(fread(b, 1, 10, file) != 10) return false;
+                            mFormat = le(b + 8, 2);
+                            size -= 10;
+                        }
+                        fseek(file, size - 16 + (size & 1), SEEK_CUR);
+                        haveFormat = true;
+                    }
+                    else if(!memcmp(b, "data", 4)){
+                        mDataStart = ftell(file);
+                        mDataBytes = size;
+                        bool pcm = mFormat == 1 && mBytes >= 1 && mBytes <= 4;
+                        bool ieee = mFormat == 3 && mBytes == 4;
+                        return haveFormat && mChannels > 0 && mFileRate > 0 && (pcm || ieee);
+                    }
+                    else
+                        fseek(file, size + (size & 1), SEEK_CUR);
+                }
+                return false;
+            }
+
+            float sample(const uint8_t* b) const {
+                if(mFormat == 3){
+                    uint32_t bits = le(b, 4);
+                    float x;
+                    memcpy(&x, &bits, 4);
+                    return x;
+                }
+                if(mBytes == 1) return (b[0] - 128) / 128.f;
+                uint32_t v = le(b, mBytes) << (32 - 8 * mBytes);    // sign bit to the top
+                return (int32_t)v / 2147483648.f;
+            }
+
+            // reader thread
+            void stream(){
+                int frameBytes = mChannels * mBytes;
+                std::vector<uint8_t> raw(chunkFrames * frameBytes);
+                std::vector<stereo_frame> frames(chunkFrames);
+                uint32_t remaining = mDataBytes;
+                size_t count = 0, pushed = 0;
+
+                while(!mStop){
+                    if(pushed < count){
+                        pushed += mRing->push(frames.data() + pushed, count - pushed);
+                        if(pushed < count) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                        continue;
+                    }
+                    size_t want = std::min<size_t>(chunkFrames, remaining / frameBytes);
+                    count = want ? fread(raw.data(), frameBytes, want, mFile) : 0;
+                    pushed = 0;
+                    remaining -= (uint32_t)(count * frameBytes);
+                    if(count == 0){
+                        if(!loop || mDataBytes < (uint32_t)frameBytes) break;
+                        fseek(mFile, mDataStart, SEEK_SET);
+                        remaining = mDataBytes;
+                        continue;
+                    }
+                    for(size_t i = 0; i < count; ++i){
+                        const uint8_t* f = &raw[i * frameBytes];
+                        frames[i].left = sample(f);
+                        frames[i].right = mChannels > 1 ? sample(f + mBytes) : frames[i].left;
+                    }
+                }
+                mFinished = true;
+            }
+
+            size_t mRingFrames;
+            std::unique_ptr<SpscQueue<stereo_frame>> mRing;
+            std::thread mReader;
+            std::atomic<bool> mStop{false};
+            std::atomic<bool> mFinished{false};
+
+            FILE* mFile = nullptr;
+            long mDataStart = 0;
+            uint32_t mDataBytes = 0;
+            uint32_t mFormat = 0;
+            uint32_t mChannels = 0;
+            uint32_t mFileRate = 0;
+            int mBytes = 0;
+
+            // audio thread resampling state
+            double mStep = 1;
+            double mPhase = 2;
+            stereo_frame mFrom{0, 0}, mTo{0, 0};
+    };
+
+// ------------------------------------------------------------------
+//      Mixer channels
+// ------------------------------------------------------------------
+
+    /*
+        A stereo track mixed into the output a block at a time: the source
+        fills a block, then gain and pan are applied in one vectorized
+        pass per side. A paused channel skips the block entirely and
+        does not pull from its source. It never touches io's frame
+        iterator, so it can run before or after the synths.
+    */
+    struct MixerChannel {
+        float gain = 1;
+        float pan = 0;          // -1 left .. 1 right, balance: the centre leaves both sides at gain
+        bool paused = false;
+
+        // source(left, right, n) writes the next n frames
+        template<class Source>
+        void process(al::AudioIOData& io, Source&& source){
+            if(paused) return;
+            float gainL = gain * std::min(1.f, 1 - pan);
+            float gainR = gain * std::min(1.f, 1 + pan);
+            int frames = (int)io.framesPerBuffer();
+            for(int frame = 0; frame < frames; frame += maxBlock){
+                int n = std::min(maxBlock, frames - frame);
+                float* left = scratch(0);
+                float* right = scratch(1);
+                source(left, right, n);
+                addScaled(io.outBuffer(0) + frame, left, gainL, n);
+                addScaled(io.outBuffer(1) + frame, right, gainR, n);
+            }
+        }
+    };
+}
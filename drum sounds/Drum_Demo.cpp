@@ -1,3 +1,14 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <new>
+#include <random>
+#include <string>
 
 #include "Gamma/Analysis.h"
 #include "Gamma/Effects.h"
@@ -6,7 +17,6 @@
 #include "Gamma/Oscillator.h"
 #include "Gamma/Spatial.h"
 #include "Gamma/Types.h"
-#include "Gamma/SamplePlayer.h"
 
 #include "al/app/al_App.hpp"
 #include "al/graphics/al_Shapes.hpp"
@@ -15,11 +25,118 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "audioTools.h"
+
 // using namespace gam;
 using namespace al;
 using namespace std;
 
-class Kick : public SynthVoice {
+// Heap allocations made by a thread while its counting flag is set; the
+// --stress run sets it around onSound to check the audio path never
+// allocates. Array and nothrow new go through this operator new.
+namespace alloc_check {
+  std::atomic<long> count{0};
+  thread_local bool counting = false;
+}
+
+void* operator new(std::size_t size) {
+  if (alloc_check::counting) alloc_check::count++;
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+class DrumVoice;
+
+// Shared by every drum voice through PolySynth user data
+struct DrumBus {
+  audio::SendBus reverbSend;  // Summed into one reverb per block by MyApp
+  audio::voice_stats stats;   // Active / free drum voice counts
+
+  // Bounded polyphony per voice type (sized in MyApp::onInit)
+  audio::VoicePool<DrumVoice> kickPool, hihatPool, snarePool, oneShotPool;
+
+  // Hits that have seeded a noise source; reset by MyApp::setupAudio so
+  // the same hits get the same noise and renders repeat exactly
+  uint32_t noiseHits = 0;
+};
+
+// Base for drum voices: bus access, voice counts, and the pool slot kept
+// as voices start and free themselves
+class DrumVoice : public SynthVoice {
+ public:
+  constexpr static int stealFrames = 128; // Fade length for stolen voices
+
+  DrumVoice() { sInstances++; }
+  ~DrumVoice() { sInstances--; }
+
+  // Drum voice objects alive: the synth's preallocated voices, any it
+  // grew while playing, and one-shot renders in progress (UI thread)
+  static int instances() { return sInstances; }
+
+  DrumBus* bus() { return static_cast<DrumBus*>(userData()); }
+
+  // Pool for this voice type, nullptr when there is none (offline renders)
+  virtual audio::VoicePool<DrumVoice>* pool() { return nullptr; }
+  // Note compared by the same-note stealing policy
+  virtual int note() { return 0; }
+
+  // Note-off frame within the block: voices with a release arm it in
+  // onTriggerOff and release from onProcess when it comes due
+  audio::ReleasePoint mRelease;
+
+  // Seed for this hit's noise source (call from onTriggerOn). Gamma seeds
+  // noise from a global, so without this no two renders would match.
+  uint32_t noiseSeed() {
+    auto* b = bus();
+    uint32_t hit = b ? ++b->noiseHits : 1;
+    return hit * 2654435761u;  // Spread consecutive hits apart
+  }
+
+  // Call from onTriggerOn
+  void started() {
+    mRelease.clear();
+    mStolen = false;
+    mFade = 1;
+    auto* b = bus();
+    if (!b) return;
+    b->stats.active++;
+    if (auto* p = pool()) p->start(this, note());
+  }
+
+  // Frees the voice back to the synth once it has finished sounding
+  void finish() {
+    if (!active()) return;
+    if (auto* b = bus()) { b->stats.active--; b->stats.completed++; }
+    if (auto* p = pool()) p->stop(this);
+    free();
+  }
+
+  // Called by the pool when a new voice needs this one's slot
+  void steal() { mStolen = true; }
+  bool stolen() const { return mStolen; }
+  bool fadedOut() const { return mStolen && mFade <= 0; }
+
+  // Fades a block of output once the voice is stolen, and reports its
+  // level to the pool. Call on the voice's final (pre-pan) signal.
+  void endBlock(float* out, int n) {
+    if (mStolen) {
+      for (int i = 0; i < n; i++) {
+        mFade = std::max(0.f, mFade - 1.f / stealFrames);
+        out[i] *= mFade;
+      }
+    }
+    if (auto* p = pool()) p->level(this, audio::peak(out, n));
+  }
+
+ private:
+  inline static std::atomic<int> sInstances{0};
+  bool mStolen = false;
+  float mFade = 1;
+};
+
+class Kick : public DrumVoice {
  public:
   // Unit generators
   gam::Pan<> mPan;
@@ -43,64 +160,86 @@ class Kick : public SynthVoice {
     createInternalTriggerParameter("frequency", 60, 20, 5000);
   }
 
+  audio::VoicePool<DrumVoice>* pool() override { return bus() ? &bus()->kickPool : nullptr; }
+  int note() override { return (int)getInternalParameterValue("frequency"); }
+
   // The audio processing function
   void onProcess(AudioIOData& io) override {
+    // Parameters are looked up once per block, outside the sample loop
     mOsc.freq(getInternalParameterValue("frequency"));
+    float amp = getInternalParameterValue("amplitude");
     mPan.pos(0);
     // (removed parameter control for attack and release)
 
-    while (io()) {
-      mOsc.freqMul(mDecay()); // Multiply pitch oscillator by next decay value
-      float s1 = mOsc() *  mAmpEnv() * getInternalParameterValue("amplitude");
-      float s2;
-      mPan(s1, s1, s2);
-      io.out(0) += s1;
-      io.out(1) += s2;
-    }
-
-    if (mAmpEnv.done()) free();
+    // Pan is linear, so pan a unit sample once and apply the gains to the block
+    float gainL = 1, gainR;
+    mPan(gainL, gainL, gainR);
+
+    audio::forEachChunk(io, mRelease.frame(*this, io),
+                        [&] { mAmpEnv.release(); mDecay.finish(); },
+                        [&](int frame, int n) {
+      float* osc = audio::scratch(0);
+      float* env = audio::scratch(1);
+      for (int i = 0; i < n; i++) {
+        mOsc.freqMul(mDecay()); // Multiply pitch oscillator by next decay value
+        osc[i] = mOsc();
+      }
+      audio::generate(env, mAmpEnv, n);
+      audio::mul(osc, env, n);
+      endBlock(osc, n);
+      audio::panAdd(io.outBuffer(0) + frame, io.outBuffer(1) + frame, osc,
+                    gainL * amp, gainR * amp, n);
+    });
+
+    if (mAmpEnv.done() || fadedOut()) finish();
   }
 
-  void onTriggerOn() override { mAmpEnv.reset(); mDecay.reset(); }
+  void onTriggerOn() override { mAmpEnv.reset(); mDecay.reset(); started(); }
 
-  void onTriggerOff() override { mAmpEnv.release(); mDecay.finish(); }
+  void onTriggerOff() override { mRelease.arm(); }
 };
 
 /* ---------------------------------------------------------------- */
 
-class Hihat : public SynthVoice {
+class Hihat : public DrumVoice {
  public:
   // Unit generators
   gam::Pan<> mPan;
-  gam::AD<> mAmpEnv; // Changed amp envelope from Env<3> to AD<>
-  
   gam::Burst mBurst; // Resonant noise with exponential decay
 
+  // Burst has no done(), so the voice frees itself once its output dies away
+  audio::SilenceDetector mTail;
+
   void init() override {
     // Initialize burst - Main freq, filter freq, duration
     mBurst = gam::Burst(20000, 15000, 0.05);
-
   }
 
+  audio::VoicePool<DrumVoice>* pool() override { return bus() ? &bus()->hihatPool : nullptr; }
+
   // The audio processing function
   void onProcess(AudioIOData& io) override {
-    while (io()) {
-      float s1 = mBurst();
-      float s2;
-      mPan(s1, s1, s2);
-      io.out(0) += s1;
-      io.out(1) += s2;
-    }
-    // Left this in because I'm not sure how to tell when a burst is done
-    if (mAmpEnv.done()) free();
+    float gainL = 1, gainR;
+    mPan(gainL, gainL, gainR);
+
+    audio::forEachChunk(io, [&](int frame, int n) {
+      float* burst = audio::scratch(0);
+      audio::generate(burst, mBurst, n);
+      mTail.update(burst, n);
+      endBlock(burst, n);
+      audio::panAdd(io.outBuffer(0) + frame, io.outBuffer(1) + frame, burst,
+                    gainL, gainR, n);
+    });
+
+    if (mTail.silent() || fadedOut()) finish();
   }
-  void onTriggerOn() override { mBurst.reset(); }
+  void onTriggerOn() override { mBurst.reset(); mBurst.src.seed(noiseSeed()); mTail.reset(); started(); }
   //void onTriggerOff() override {  }
 };
 
 /* ---------------------------------------------------------------- */
 
-class Snare : public SynthVoice {
+class Snare : public DrumVoice {
  public:
   // Unit generators
   gam::Pan<> mPan;
@@ -108,8 +247,8 @@ class Snare : public SynthVoice {
   gam::Sine<> mOsc; // Main pitch osc (top of drum)
   gam::Sine<> mOsc2; // Secondary pitch osc (bottom of drum)
   gam::Decay<> mDecay; // Pitch decay for oscillators
-  gam::ReverbMS<> reverb;	// Schroeder reverberator
   gam::Burst mBurst; // Noise to simulate rattle/chains
+  float mReverbSend = 0.2; // Level sent to the shared reverb bus
 
 
   void init() override {
@@ -123,44 +262,176 @@ class Snare : public SynthVoice {
 
     // Initialize pitch decay 
     mDecay.decay(0.8);
-
-    reverb.resize(gam::FREEVERB);
-		reverb.decay(0.5); // Set decay length, in seconds
-		reverb.damping(0.2); // Set high-frequency damping factor in [0, 1]
-
   }
 
+  audio::VoicePool<DrumVoice>* pool() override { return bus() ? &bus()->snarePool : nullptr; }
+
   // The audio processing function
   void onProcess(AudioIOData& io) override {
     mOsc.freq(200);
     mOsc2.freq(150);
 
-    while (io()) {
-      
-      // Each mDecay() call moves it forward (I think), so we only want
-      // to call it once per sample
-      float decay = mDecay();
-      mOsc.freqMul(decay);
-      mOsc2.freqMul(decay);
-
-      float amp = mAmpEnv();
-      float s1 = mBurst() + (mOsc() * amp * 0.1)+ (mOsc2() * amp * 0.05);
-      s1 += reverb(s1) * 0.2;
-      float s2;
-      mPan(s1, s1, s2);
-      io.out(0) += s1;
-      io.out(1) += s2;
-    }
+    float gainL = 1, gainR;
+    mPan(gainL, gainL, gainR);
+    auto* bus = this->bus();
+
+    audio::forEachChunk(io, mRelease.frame(*this, io),
+                        [&] { mAmpEnv.release(); mDecay.finish(); },
+                        [&](int frame, int n) {
+      float* s1 = audio::scratch(0);
+      float* osc2 = audio::scratch(1);
+      float* env = audio::scratch(2);
+      float* tmp = audio::scratch(3);
+
+      for (int i = 0; i < n; i++) {
+        // Each mDecay() call moves it forward (I think), so we only want
+        // to call it once per sample
+        float decay = mDecay();
+        mOsc.freqMul(decay);
+        mOsc2.freqMul(decay);
+        s1[i] = mOsc();
+        osc2[i] = mOsc2();
+      }
+      audio::generate(env, mAmpEnv, n);
+
+      // s1 = burst + (osc * 0.1 + osc2 * 0.05) * env
+      audio::scale(s1, 0.1, n);
+      audio::addScaled(s1, osc2, 0.05, n);
+      audio::mul(s1, env, n);
+      audio::generate(tmp, mBurst, n);
+      audio::add(s1, tmp, n);
+      endBlock(s1, n);
+
+      if (bus) bus->reverbSend.send(frame, s1, mReverbSend, n);
+      audio::panAdd(io.outBuffer(0) + frame, io.outBuffer(1) + frame, s1,
+                    gainL, gainR, n);
+    });
     
-    if (mAmpEnv.done()) free();
+    if (mAmpEnv.done() || fadedOut()) finish();
+  }
+  void onTriggerOn() override {
+    mBurst.reset();
+    mBurst.src.seed(noiseSeed());
+    mAmpEnv.reset();
+    mDecay.reset();
+    started();
   }
-  void onTriggerOn() override { mBurst.reset(); mAmpEnv.reset(); mDecay.reset();}
   
-  void onTriggerOff() override { mAmpEnv.release(); mDecay.finish(); }
+  void onTriggerOff() override { mRelease.arm(); }
 };
 
 /* ---------------------------------------------------------------- */
 
+// Plays back a pre-rendered drum hit from the one-shot cache
+class OneShot : public DrumVoice {
+ public:
+  std::shared_ptr<const audio::clip> mClip;
+  int mPos = 0;
+
+  // Set before scheduling; the previous clip is released here, off the audio thread
+  void play(std::shared_ptr<const audio::clip> clip) { mClip = std::move(clip); }
+
+  audio::VoicePool<DrumVoice>* pool() override { return bus() ? &bus()->oneShotPool : nullptr; }
+  // Same clip counts as the same note
+  int note() override { return (int)(reinterpret_cast<uintptr_t>(mClip.get()) >> 4); }
+
+  void onProcess(AudioIOData& io) override {
+    auto* bus = this->bus();
+    int frames = mClip ? mClip->frames() : 0;
+
+    audio::forEachChunk(io, [&](int frame, int n) {
+      int count = std::min(n, frames - mPos);
+      if (count <= 0) return;
+      const float* left = mClip->left.data() + mPos;
+      const float* right = mClip->right.data() + mPos;
+      const float* send = mClip->send.empty() ? nullptr : mClip->send.data() + mPos;
+
+      // Stolen: fade a gain ramp and apply it to each stored channel
+      if (stolen()) {
+        float* gain = audio::scratch(0);
+        std::fill(gain, gain + count, 1.f);
+        endBlock(gain, count);
+        float* l = audio::scratch(1);
+        float* r = audio::scratch(2);
+        std::copy(left, left + count, l);
+        std::copy(right, right + count, r);
+        audio::mul(l, gain, count);
+        audio::mul(r, gain, count);
+        left = l;
+        right = r;
+        if (send) {
+          float* sn = audio::scratch(3);
+          std::copy(send, send + count, sn);
+          audio::mul(sn, gain, count);
+          send = sn;
+        }
+      }
+      else if (auto* p = pool()) {
+        p->level(this, audio::peak(left, count));
+      }
+
+      audio::add(io.outBuffer(0) + frame, left, count);
+      audio::add(io.outBuffer(1) + frame, right, count);
+      if (bus && send) bus->reverbSend.send(frame, send, 1, count);
+      mPos += count;
+    });
+
+    if (mPos >= frames || fadedOut()) finish();
+  }
+
+  void onTriggerOn() override { mPos = 0; started(); }
+  // Release is part of the rendered clip
+  void onTriggerOff() override {}
+};
+
+/* ---------------------------------------------------------------- */
+
+// One bar of 4/4 per groove, compiled to sorted hits at compile time.
+// Each lane spreads its steps over the bar: 16 chars = sixteenths,
+// 32 = thirty-seconds.
+namespace grooves {
+  enum : uint8_t { kick, snare, hihat };
+
+  constexpr audio::groove backbeat = audio::makeGroove({
+    {hihat, "x.x.x.x.x.x.x.x."},
+    {kick,  "x.......x.......", 100},
+    {snare, "....x.......x..."},
+  });
+
+  constexpr audio::groove backbeatB = audio::makeGroove({
+    {hihat, "x.x.x.x.x.x.x.x."},
+    {kick,  "x.......x.x.....", 100},
+    {snare, "....x.......x..."},
+  });
+
+  constexpr audio::groove house = audio::makeGroove({
+    {hihat, "..x...x...x...x."},
+    {kick,  "x.........x...x.", 100},
+    {snare, "....x.......x..."},
+  });
+
+  constexpr audio::groove reggaeton = audio::makeGroove({
+    {kick,  "x...x...x...x...", 150},
+    {snare, "...x..x....x..x."},
+  });
+
+  constexpr audio::groove trap = audio::makeGroove({
+    {hihat, "xxxxxxxxxxxxxxxx"},
+    {kick,  "x.......x..x....", 150},
+    {snare, "....x.......x..."},
+  });
+
+  constexpr audio::groove trapB = audio::makeGroove({
+    {hihat, "xxxxxxxxxxxxxxxx"},
+    {kick,  "x.......x..x....", 150},
+    {snare, "........x...............x.x.x.xx"},
+  });
+
+  static_assert(trapB.count == 25 && trapB.events[24].beat == 3.875f);
+}
+
+/* ---------------------------------------------------------------- */
+
 class MyApp : public App {
  public:
   SynthGUIManager<Kick> synthManager{"Kick"};
@@ -168,9 +439,25 @@ class MyApp : public App {
   // Set to 'true' if using samples
   bool hasSample = true; 
 
-  // Added SamplePlayer to mix in external audio clips
-  gam::SamplePlayer<> samplePlayer;
-  bool paused = true;
+  // Streams external audio clips (backing stems) from disk while playing
+  audio::StreamPlayer samplePlayer;
+  audio::MixerChannel sampleTrack{1, 0, true};  // Starts paused ('p' toggles)
+
+  // One reverb shared by all snare voices through the send bus
+  DrumBus drumBus;
+  gam::ReverbMS<> reverb;	// Schroeder reverberator
+  gam::Pan<> reverbPan;
+
+  // Pre-rendered drum hits, keyed by voice type, trigger params, duration
+  // and sample rate. Off by default ('c' toggles it): a miss renders the
+  // hit on the UI thread, which stalls the first press of each new sound
+  audio::ClipCache oneShots;
+
+  // Hits queued by the play functions, submitted as one sorted batch per
+  // key press and triggered by the scheduler on the audio thread
+  audio::EventScheduler scheduler;
+  std::vector<audio::note_event> batch;
+  audio::CallbackMonitor callbacks;  // Audio callback overruns ('v' prints)
 
   ParameterMIDI parameterMIDI;
   int midiNote;
@@ -178,8 +465,34 @@ class MyApp : public App {
   gam::Burst mBurst();
 
   void onInit() override {
+    setupAudio(audioIO().framesPerSecond(), audioIO().framesPerBuffer());
+  }
+
+  // Everything the audio graph needs, shared by live and offline rendering
+  void setupAudio(double sampleRate, int blockSize) {
     // Set sampling rate for Gamma objects from app's audio
-    gam::sampleRate(audioIO().framesPerSecond());
+    gam::sampleRate(sampleRate);
+
+    reverb.resize(gam::FREEVERB);
+    reverb.decay(0.5); // Set decay length, in seconds
+    reverb.damping(0.2); // Set high-frequency damping factor in [0, 1]
+    drumBus.reverbSend.resize(blockSize);
+    drumBus.noiseHits = 0;
+    batch.reserve(1024);
+    synthManager.synth().setDefaultUserData(&drumBus);
+
+    // Voice pools: audible polyphony per type, and voices preallocated up
+    // front. Preallocation covers hits scheduled ahead (a 'd' trap run
+    // queues 64 hi-hats) so getVoice() never has to allocate while playing.
+    drumBus.kickPool.reserve(4, audio::steal_policy::same_note);
+    drumBus.hihatPool.reserve(8, audio::steal_policy::oldest);
+    drumBus.snarePool.reserve(8, audio::steal_policy::quietest);
+    drumBus.oneShotPool.reserve(32, audio::steal_policy::oldest);
+    synthManager.synth().allocatePolyphony<Kick>(32);
+    synthManager.synth().allocatePolyphony<Hihat>(96);
+    synthManager.synth().allocatePolyphony<Snare>(48);
+    synthManager.synth().allocatePolyphony<OneShot>(192);
+    drumBus.stats.allocated = DrumVoice::instances();
   }
 
   void onCreate() override {
@@ -192,20 +505,31 @@ class MyApp : public App {
     //    synthManager.synthSequencer().playSequence("synth4.synthSequence");
     synthManager.synthRecorder().verbose(true);
 
-    // Load audio sample (files go in bin folder)
-    if(hasSample) samplePlayer.load("guitartest.wav");
+    // Open audio sample (files go in bin folder); it streams as it plays
+    if (hasSample && !samplePlayer.open("guitartest.wav", audioIO().framesPerSecond())) {
+      std::cerr << "could not open guitartest.wav" << std::endl;
+      hasSample = false;
+    }
 
   }
 
   void onSound(AudioIOData& io) override {
+    callbacks.begin();
+    scheduler.render(io, synthManager.synth());  // Start and release due hits
     synthManager.render(io);  // Render audio
+
+    // Reverb return, panned like the snare voices that feed it
+    float gainL = 1, gainR;
+    reverbPan(gainL, gainL, gainR);
+    drumBus.reverbSend.process(io, reverb, gainL, gainR);
     
-    // After rendering synths, 
-    while(io() && !paused && hasSample){  
-      float s = samplePlayer();
-      io.out(0) +=  s;
-      io.out(1) += s;
-	  }
+    // Sample track, mixed a whole block at a time (nothing to do while paused)
+    if (hasSample) {
+      sampleTrack.process(io, [&](float* left, float* right, int n) {
+        samplePlayer.read(left, right, n);
+      });
+    }
+    callbacks.end(io);
   }
 
   void onAnimate(double dt) override {
@@ -221,23 +545,39 @@ class MyApp : public App {
     imguiDraw();
   }
 
-  bool onKeyDown(Keyboard const& k) override {
+  bool onKeyDown(Keyboard const& k) override { return handleKey(k.key()); }
+
+  // Key handling, also used to queue patterns for offline renders
+  bool handleKey(int key) {
     
     // testing grounds
-    if(k.key() == 'e') playSnare(0, 0.2);
-    if(k.key() == 'w') playSnare(0, 2);
-    if(k.key() == 'q') playKick(150, 0, 0.4, 0.9);
+    if(key == 'e') playSnare(0, 0.2);
+    if(key == 'w') playSnare(0, 2);
+    if(key == 'q') playKick(150, 0, 0.4, 0.9);
+    if(key == 'c') oneShots.enabled = !oneShots.enabled;
+    if(key == 'p') sampleTrack.paused = !sampleTrack.paused;
+    if(key == 'v') {
+      auto& stats = drumBus.stats;
+      stats.allocated = DrumVoice::instances();  // No one-shot render is running here
+      std::cout << "drum voices: " << stats.active << " active, "
+                << stats.available() << " free, " << stats.completed
+                << " completed, "
+                << drumBus.kickPool.stolen() + drumBus.hihatPool.stolen() +
+                   drumBus.snarePool.stolen() + drumBus.oneShotPool.stolen()
+                << " stolen" << std::endl;
+      printStats();
+    }
 
-    if(k.key() == '1') playKick(50, 0, 0.4, 0.9);
-    if(k.key() == '2') playKick(100, 0, 0.4, 0.9);
-    if(k.key() == '3') playKick(150, 0, 0.4, 0.9);
-    if(k.key() == '4') playKick(200, 0, 0.4, 0.9);
-    if(k.key() == '5') playKick(250, 0, 0.4, 0.9);
-    if(k.key() == '6') playKick(300, 0, 0.4, 0.9);
+    if(key == '1') playKick(50, 0, 0.4, 0.9);
+    if(key == '2') playKick(100, 0, 0.4, 0.9);
+    if(key == '3') playKick(150, 0, 0.4, 0.9);
+    if(key == '4') playKick(200, 0, 0.4, 0.9);
+    if(key == '5') playKick(250, 0, 0.4, 0.9);
+    if(key == '6') playKick(300, 0, 0.4, 0.9);
 
-    if(k.key() == 'g') playReggaeton(96,0);
+    if(key == 'g') playReggaeton(96,0);
 
-    if(k.key() == 'd') {
+    if(key == 'd') {
       float currTime=0;
       float tempo = 90;
       currTime = playTrap(tempo, currTime);
@@ -246,7 +586,7 @@ class MyApp : public App {
       currTime = playTrap(tempo, currTime, 'b');
     }
 
-    if(k.key() == 'a') {
+    if(key == 'a') {
       float currTime=0;
       currTime= playBackbeat(120, currTime);
       currTime= playHouse(160, currTime);
@@ -256,12 +596,16 @@ class MyApp : public App {
     }
 
     
-    if(k.key() == 'h'){
+    if(key == 'h'){
       for(int i=0; i<4; i++){
         playHouse(140, i);
       }
     }
 
+    // Everything this key queued goes to the scheduler in one batch
+    scheduler.submit(batch);
+    batch.clear();
+
     return true;
   }
 
@@ -276,127 +620,421 @@ class MyApp : public App {
 
   void onExit() override { imguiShutdown(); }
 
+  void printStats() {
+    auto& s = scheduler.stats;
+    std::cout << "scheduler: " << s.started << " started, " << s.late
+              << " late (worst " << s.maxLateFrames << " frames), " << s.dropped
+              << " dropped; callbacks: " << callbacks.overruns << " overruns in "
+              << callbacks.blocks << " blocks, peak load " << callbacks.peakLoad
+              << std::endl;
+  }
+
+  // Renders the patterns for the given keys without an audio device;
+  // returns interleaved samples, the same on every run
+  std::vector<float> render(const audio::render_settings& settings, const std::string& keys) {
+    setupAudio(settings.sampleRate, settings.blockSize);
+    for (char key : keys) handleKey(key);
+    return audio::renderOffline(settings, [&](AudioIOData& io) { onSound(io); });
+  }
+
+  // Renders the patterns for the given keys and writes them to a WAV file
+  int renderToFile(const char* path, const audio::render_settings& settings, const std::string& keys) {
+    auto samples = render(settings, keys);
+    if (!audio::writeWav(path, samples, settings.channels, settings.sampleRate)) {
+      std::cerr << "could not write " << path << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  // Renders offline while scheduling hitsPerSecond hits through the normal
+  // play path, each block's hits submitted just before it renders. Fails
+  // if scheduling or onSound allocates after the first second, or if
+  // getVoice() had to grow the synth's voices.
+  int stressTest(const audio::render_settings& settings, double hitsPerSecond) {
+    setupAudio(settings.sampleRate, settings.blockSize);
+
+    // Room for two blocks of hits per type on top of the demo's voices:
+    // the hits being submitted plus the ones still fading out
+    double blockSeconds = settings.blockSize / settings.sampleRate;
+    int perBlock = (int)std::ceil(hitsPerSecond * blockSeconds);
+    synthManager.synth().allocatePolyphony<Kick>(2 * perBlock);
+    synthManager.synth().allocatePolyphony<Hihat>(2 * perBlock);
+    synthManager.synth().allocatePolyphony<Snare>(2 * perBlock);
+    batch.reserve(perBlock);
+    int voices = DrumVoice::instances();
+    drumBus.stats.allocated = voices;
+
+    long hits = 0, warmBlocks = std::lround(1 / blockSeconds), block = 0;
+    long scheduling = 0, rendering = 0;
+    double owed = 0;
+    audio::renderOffline(settings, [&](AudioIOData& io) {
+      alloc_check::counting = block++ >= warmBlocks;
+      long before = alloc_check::count;
+      int n = (int)(owed += hitsPerSecond * blockSeconds);
+      owed -= n;
+      for (int i = 0; i < n; i++, hits++) {
+        float time = blockSeconds * i / n;
+        switch (hits % 4) {  // hat, kick, hat, snare
+          case 1: playKick(50 + 10 * (hits % 7), time, 0.4, 0.9); break;
+          case 3: playSnare(time, 0.1); break;
+          default: playHihat(time); break;
+        }
+      }
+      scheduler.submit(batch);
+      batch.clear();
+      scheduling += alloc_check::count - before;
+
+      before = alloc_check::count;
+      onSound(io);
+      rendering += alloc_check::count - before;
+      alloc_check::counting = false;
+    });
+
+    std::cout << "stress: " << hits << " hits; after the first second " << scheduling
+              << " allocations scheduling, " << rendering << " in onSound; voices "
+              << voices << " -> " << DrumVoice::instances() << std::endl;
+    printStats();
+    return scheduling == 0 && rendering == 0 && DrumVoice::instances() == voices ? 0 : 1;
+  }
+
+  // Schedules a drum hit. With the cache enabled the first hit for a set of
+  // params is rendered offline and later hits replay it through a OneShot voice
+  template <class Voice>
+  void playDrum(audio::trigger_params params, float time, float duration)
+  {
+      if (oneShots.enabled) {
+        audio::clip_key key{typeid(Voice), params, duration, gam::sampleRate()};
+        auto clip = oneShots.find(key);
+        if (!clip) clip = oneShots.insert(key, renderOneShot<Voice>(params, duration));
+
+        auto *voice = synthManager.synth().getVoice<OneShot>();
+        voice->play(std::move(clip));
+        batch.push_back({voice, time, duration});
+        return;
+      }
+
+      auto *voice = synthManager.synth().getVoice<Voice>();
+      if (!params.empty()) voice->setTriggerParams(params.values, params.count);
+      batch.push_back({voice, time, duration});
+  }
+
+  template <class Voice>
+  audio::clip renderOneShot(audio::trigger_params params, float duration)
+  {
+      Voice voice;
+      DrumBus bus;
+      voice.init();
+      voice.userData(&bus);
+      if (!params.empty()) voice.setTriggerParams(params.values, params.count);
+      return audio::renderVoice(voice, duration, gam::sampleRate(), &bus.reverbSend);
+  }
+
   void playKick(float freq, float time, float duration = 0.5, float amp = 0.2, float attack = 0.01, float decay = 0.1)
   {
-      auto *voice = synthManager.synth().getVoice<Kick>();
-      // amp, freq, attack, release, pan
-      voice->setTriggerParams({amp, freq, 0.01, 0.1, 0.0});
-      voice->setInternalParameterValue("freq", freq);
-      synthManager.synthSequencer().addVoiceFromNow(voice, time, duration);
+      // amp, freq
+      playDrum<Kick>({amp, freq}, time, duration);
   }
 
   void playHihat(float time, float duration = 0.3)
   {
-      auto *voice = synthManager.synth().getVoice<Hihat>();
-      // amp, freq, attack, release, pan
-      synthManager.synthSequencer().addVoiceFromNow(voice, time, duration);
+      playDrum<Hihat>({}, time, duration);
   }
 
   void playSnare(float time, float duration = 0.3)
   {
-      auto *voice = synthManager.synth().getVoice<Snare>();
-      // amp, freq, attack, release, pan
-      synthManager.synthSequencer().addVoiceFromNow(voice, time, duration);
+      playDrum<Snare>({}, time, duration);
   }
 
-  float playBackbeat(float tempo, float currTime=0, char take='a'){
-    float beat = 60./tempo;
-    float offset = currTime;
-
-    for(int i=0; i<8; i++){
-      float time = (i/2.)*beat;
-      playHihat(time+offset);
-    }
-
-    switch(take){
-      case 'a':
-        playKick(100, 0*beat+offset, 0.4, 0.9);
-        playKick(100, 2*beat+offset, 0.4, 0.9);
-        break;
-      case 'b':
-        playKick(100, 0*beat+offset, 0.4, 0.9);
-        playKick(100, 2*beat+offset, 0.4, 0.9);
-        playKick(100, 2.5*beat+offset, 0.4, 0.9);
-        break;
+  // Schedules one bar of a groove from currTime, with tempo and swing
+  // applied here; returns the time the bar ends
+  float playGroove(const audio::groove& groove, float tempo, float currTime = 0, float swing = 0) {
+    for (const auto& hit : groove) {
+      float time = currTime + audio::grooveTime(hit.beat, tempo, swing);
+      switch (hit.voice) {
+        case grooves::kick: playKick(hit.param, time, 0.4, 0.9); break;
+        case grooves::snare: playSnare(time, 0.1); break;
+        case grooves::hihat: playHihat(time); break;
+      }
     }
-    
-    playSnare(1*beat+offset, 0.1);
-    playSnare(3*beat+offset, 0.1);
+    return currTime + groove.beats * 60. / tempo;
+  }
 
-    return (4*beat)+currTime;
+  float playBackbeat(float tempo, float currTime=0, char take='a'){
+    return playGroove(take == 'b' ? grooves::backbeatB : grooves::backbeat, tempo, currTime);
   }
 
   float playHouse(float tempo, float currTime=0){
-    float beat = 60./tempo;
-    float offset = currTime;
-
-    playHihat(0.5*beat+offset);
-    playHihat(1.5*beat+offset);
-    playHihat(2.5*beat+offset);
-    playHihat(3.5*beat+offset);
-
-
-    playKick(100, 0*beat+offset, 0.4, 0.9);
-    playKick(100, 2.5*beat+offset, 0.4, 0.9);
-    playKick(100, 3.5*beat+offset, 0.4, 0.9);
-    playSnare(1*beat+offset, 0.1);
-    playSnare(3*beat+offset, 0.1);
-
-    return (4*beat)+currTime;
+    return playGroove(grooves::house, tempo, currTime);
   }
 
   float playReggaeton(float tempo, float currTime=0){
-    float beat = 60./tempo;
-    float offset = currTime;
-
-    playKick(150, 0*beat+currTime, 0.4, 0.9);
-    playKick(150, 1*beat+currTime, 0.4, 0.9);
-    playKick(150, 2*beat+currTime, 0.4, 0.9);
-    playKick(150, 3*beat+currTime, 0.4, 0.9);
-
-    playSnare(0.75*beat+offset, 0.1);
-    playSnare(1.5*beat+offset, 0.1);
-    playSnare(2.75*beat+offset, 0.1);
-    playSnare(3.5*beat+offset, 0.1);
-
-    return (4*beat)+offset;
+    return playGroove(grooves::reggaeton, tempo, currTime);
   }
 
   float playTrap(float tempo, float currTime=0, char take='a'){
-    float beat = 60./tempo;
+    return playGroove(take == 'b' ? grooves::trapB : grooves::trap, tempo, currTime);
+  }
+};
 
-    for(int i=0; i<16; i++){
-      float time = (beat/4.0)*i;
-      playHihat(time+currTime);
+// Checks that need no audio device; returns the number of failures
+int selfTest() {
+  int failures = 0;
+  auto check = [&](bool ok, const std::string& what) {
+    if (!ok) {
+      if (failures < 20) std::cerr << "FAIL " << what << std::endl;
+      failures++;
     }
+  };
+
+  // MixerChannel writes the whole block whatever the frame iterator says,
+  // so run it the way it runs in onSound: after the voices have consumed
+  // io. The block is longer than maxBlock so it is mixed in two chunks.
+  AudioIOData io;
+  io.framesPerBuffer(1500);
+  io.channelsOut(2);
+  int frames = (int)io.framesPerBuffer();
+  auto constant = [](float* left, float* right, int n) {
+    audio::fill(left, 0.5f, n);
+    audio::fill(right, 0.5f, n);
+  };
+  auto outputIs = [&](float left, float right) {
+    for (int i = 0; i < frames; ++i)
+      if (std::abs(io.outBuffer(0)[i] - left) > 1e-6f || std::abs(io.outBuffer(1)[i] - right) > 1e-6f)
+        return false;
+    return true;
+  };
+
+  io.zeroOut();
+  io.frame(0);
+  while (io()) {}
+  audio::MixerChannel channel{0.8f, 0.5f, false};
+  channel.process(io, constant);
+  check(outputIs(0.2f, 0.4f), "MixerChannel gain 0.8 pan 0.5: 0.5 in, 0.2 / 0.4 out");
+
+  // Paused: the source is not pulled and the output is left as it was
+  bool pulled = false;
+  channel.paused = true;
+  channel.process(io, [&](float* left, float* right, int n) {
+    pulled = true;
+    constant(left, right, n);
+  });
+  check(!pulled && outputIs(0.2f, 0.4f), "paused MixerChannel leaves the output unchanged");
+
+  // Offline renders repeat exactly: two apps rendering the same grooves
+  // (kicks, snares and hats) must produce the same bytes
+  audio::render_settings settings;
+  settings.seconds = 4;
+  std::vector<float> renders[2];
+  for (auto& samples : renders) {
+    MyApp app;
+    samples = app.render(settings, "a");
+  }
+  check(renders[0].size() == renders[1].size() &&
+            std::memcmp(renders[0].data(), renders[1].data(), renders[0].size() * sizeof(float)) == 0,
+        "two renders of the 'a' grooves differ");
+
+  if (failures == 0)
+    std::cout << "self test passed" << std::endl;
+  else
+    std::cout << "self test failed: " << failures << " failures" << std::endl;
+  return failures == 0 ? 0 : 1;
+}
 
-    
-    playKick(150, 0*beat+currTime, 0.4, 0.9);
-    playKick(150, 2*beat+currTime, 0.4, 0.9);
-    playKick(150, 2.75*beat+currTime, 0.4, 0.9);
+// The drum voices as they rendered before block processing, one io() frame
+// at a time; kept only as the --bench baseline
+namespace baseline {
+class Kick : public ::Kick {
+ public:
+  void onProcess(AudioIOData& io) override {
+    mOsc.freq(getInternalParameterValue("frequency"));
+    float amp = getInternalParameterValue("amplitude");
+    while (io()) {
+      mOsc.freqMul(mDecay());
+      float s1 = mOsc() * mAmpEnv() * amp;
+      float s2;
+      mPan(s1, s1, s2);
+      io.out(0) += s1;
+      io.out(1) += s2;
+    }
+    if (mAmpEnv.done()) finish();
+  }
+};
 
-    if(take == 'a'){
-      playSnare(1.0*beat+currTime, 0.1);
-      playSnare(3.0*beat+currTime, 0.1);
+// Kick as it was before its parameters were read once per block: the
+// amplitude is looked up by name on every sample
+class LookupKick : public ::Kick {
+ public:
+  void onProcess(AudioIOData& io) override {
+    mOsc.freq(getInternalParameterValue("frequency"));
+    while (io()) {
+      mOsc.freqMul(mDecay());
+      float s1 = mOsc() * mAmpEnv() * getInternalParameterValue("amplitude");
+      float s2;
+      mPan(s1, s1, s2);
+      io.out(0) += s1;
+      io.out(1) += s2;
     }
-    else{
-      playSnare(1.0*beat+currTime, 0.1);
-      playSnare(3.0*beat+currTime, 0.1);
-      playSnare(3.25*beat+currTime, 0.1);
-      playSnare(3.5*beat+currTime, 0.1);
-      playSnare(3.75*beat+currTime, 0.1);
-      playSnare(3.875*beat+currTime, 0.1);
+    if (mAmpEnv.done()) finish();
+  }
+};
+
+class Hihat : public ::Hihat {
+ public:
+  void onProcess(AudioIOData& io) override {
+    while (io()) {
+      float s1 = mBurst();
+      mTail.update(&s1, 1);
+      float s2;
+      mPan(s1, s1, s2);
+      io.out(0) += s1;
+      io.out(1) += s2;
     }
-    
-    
+    if (mTail.silent()) finish();
+  }
+};
+
+class Snare : public ::Snare {
+ public:
+  void onProcess(AudioIOData& io) override {
+    mOsc.freq(200);
+    mOsc2.freq(150);
+    while (io()) {
+      float decay = mDecay();
+      mOsc.freqMul(decay);
+      mOsc2.freqMul(decay);
+      float amp = mAmpEnv();
+      float s1 = mBurst() + (mOsc() * amp * 0.1) + (mOsc2() * amp * 0.05);
+      bus()->reverbSend.send(io.frame(), &s1, mReverbSend, 1);
+      float s2;
+      mPan(s1, s1, s2);
+      io.out(0) += s1;
+      io.out(1) += s2;
+    }
+    if (mAmpEnv.done()) finish();
+  }
+};
 
-    return (4*beat)+currTime;
+// SynthSequencer::addVoiceFromNow as allolib does it: one lock and one walk
+// of the sorted event list per note
+struct SequencerList {
+  struct event {
+    double start, duration;
+    SynthVoice* voice;
+  };
+  std::mutex lock;
+  std::list<event> events;
+
+  void add(SynthVoice* voice, double start, double duration) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = events.begin();
+    while (it != events.end() && it->start <= start) ++it;
+    events.insert(it, {start, duration, voice});
   }
 };
+}  // namespace baseline
+
+// Renders `voices` copies of a drum voice for `blocks` blocks, triggering
+// each again when it finishes; returns nanoseconds per voice per block
+template <class Voice>
+double voiceBlockNs(int blockSize, int voices, int blocks) {
+  DrumBus bus;
+  bus.reverbSend.resize(blockSize);
+  AudioIOData io;
+  io.framesPerBuffer(blockSize);
+  io.channelsOut(2);
+
+  std::vector<Voice> pool(voices);
+  for (auto& voice : pool) {
+    voice.init();
+    voice.userData(&bus);
+    voice.triggerOn();
+  }
+  auto begin = std::chrono::steady_clock::now();
+  for (int block = 0; block < blocks; block++) {
+    io.zeroOut();
+    for (auto& voice : pool) {
+      io.frame(0);
+      voice.onProcess(io);
+      if (!voice.active()) voice.triggerOn();
+    }
+    bus.reverbSend.clear();
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+  return ns / ((double)voices * blocks);
+}
+
+// Render cost per drum voice against the per-sample baseline, the voices
+// one core could render in real time at that cost, and the cost of
+// scheduling `events` hits
+int bench(int blockSize, int events) {
+  double sampleRate = 48000;
+  gam::sampleRate(sampleRate);
+  double blockNs = blockSize / sampleRate * 1e9;
+  auto report = [&](const char* name, double ns, double baselineNs) {
+    printf("%s: %.0f ns per voice per %d-frame block (%.0f voices in real time), "
+           "per-sample baseline %.0f ns (%.1fx)\n",
+           name, ns, blockSize, blockNs / ns, baselineNs, baselineNs / ns);
+  };
+  double kickNs = voiceBlockNs<Kick>(blockSize, 32, 2000);
+  report("kick", kickNs, voiceBlockNs<baseline::Kick>(blockSize, 32, 2000));
+  double lookupNs = voiceBlockNs<baseline::LookupKick>(blockSize, 32, 2000);
+  printf("kick, amplitude looked up every sample: %.0f ns per voice per block (%.1fx)\n",
+         lookupNs, lookupNs / kickNs);
+  report("hihat", voiceBlockNs<Hihat>(blockSize, 32, 2000), voiceBlockNs<baseline::Hihat>(blockSize, 32, 2000));
+  report("snare", voiceBlockNs<Snare>(blockSize, 32, 2000), voiceBlockNs<baseline::Snare>(blockSize, 32, 2000));
+
+  // Scheduling a batch of random hits: one sorted submit against the
+  // per-note sorted-list insert
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> when(0, 60);
+  std::vector<audio::note_event> hits(events);
+  for (auto& hit : hits) hit = {nullptr, when(rng), 0.1};
+  audio::EventScheduler scheduler(events);
+  auto begin = std::chrono::steady_clock::now();
+  scheduler.submit(hits);
+  double batchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+  baseline::SequencerList sequencer;
+  begin = std::chrono::steady_clock::now();
+  for (auto& hit : hits) sequencer.add(hit.voice, hit.start, hit.duration);
+  double listMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+  printf("scheduling %d random hits: %.2f ms as one batch, %.1f ms inserted one at a time (%s)\n",
+         events, batchMs, listMs, scheduler.stats.dropped ? "some dropped" : "none dropped");
+
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  // Checks, no audio device or window:
+  //   Drum_Demo --selftest
+  if (argc > 1 && std::string(argv[1]) == "--selftest") return selfTest();
+
+  // Micro-benchmarks, no audio device or window:
+  //   Drum_Demo --bench [blockSize] [events]
+  if (argc > 1 && std::string(argv[1]) == "--bench")
+    return bench(argc > 2 ? atoi(argv[2]) : 512, argc > 3 ? atoi(argv[3]) : 10000);
 
-int main() {
   MyApp app;
 
+  // Offline render, no audio device or window:
+  //   Drum_Demo --render out.wav [seconds] [sampleRate] [blockSize] [keys]
+  if (argc > 2 && std::string(argv[1]) == "--render") {
+    audio::render_settings settings;
+    settings.seconds = argc > 3 ? atof(argv[3]) : 12;
+    settings.sampleRate = argc > 4 ? atof(argv[4]) : 48000;
+    settings.blockSize = argc > 5 ? atoi(argv[5]) : 512;
+    return app.renderToFile(argv[2], settings, argc > 6 ? argv[6] : "a");
+  }
+
+  // Allocation stress run, no audio device or window:
+  //   Drum_Demo --stress [seconds] [hitsPerSecond] [blockSize]
+  if (argc > 1 && std::string(argv[1]) == "--stress") {
+    audio::render_settings settings;
+    settings.seconds = argc > 2 ? atof(argv[2]) : 10;
+    settings.blockSize = argc > 4 ? atoi(argv[4]) : 512;
+    return app.stressTest(settings, argc > 3 ? atof(argv[3]) : 10000);
+  }
+
   // Set up audio
   app.configureAudio(48000., 512, 2, 0);
 
@@ -12,8 +12,8 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
-#include "theory.h"
-#include "tempo.h"
+#include "theoryOne.h"
+#include "audioTools.h"
 
 // using namespace gam;
 using namespace al;
@@ -24,22 +24,15 @@ class SquareWave : public SynthVoice
 public:
   // Unit generators
   gam::Pan<> mPan;
-  gam::Sine<> mOsc1;
-  gam::Sine<> mOsc3;
-  gam::Sine<> mOsc5;
-  gam::Sine<> mOsc7;
+  audio::WavetableOsc mOsc; // odd harmonics 1-7, band-limited per octave
 
-  gam::Env<3> mAmpEnv;
+  audio::LinearEnvelope mAmpEnv; // attack, sustain, release
+  audio::ReleasePoint mRelease;  // note-off frame within the block
 
   // Initialize voice. This function will only be called once per voice when
   // it is created. Voices will be reused if they are idle.
   void init() override
   {
-    // Intialize envelope
-    mAmpEnv.curve(0); // make segments lines
-    mAmpEnv.levels(0, 1, 1, 0);
-    mAmpEnv.sustainPoint(2); // Make point 2 sustain until a release is issued
-
     createInternalTriggerParameter("amplitude", 0.8, 0.0, 1.0);
     createInternalTriggerParameter("frequency", 440, 20, 5000);
     createInternalTriggerParameter("attackTime", 0.1, 0.01, 3.0);
@@ -57,32 +50,48 @@ public:
     // Parameters will update values once per audio callback because they
     // are outside the sample processing loop.
     float f = getInternalParameterValue("frequency");
-    mOsc1.freq(f);
-    mOsc3.freq(f * 3);
-    mOsc5.freq(f * 5);
-    mOsc7.freq(f * 7);
+    mOsc.freq(f);
 
     float a = getInternalParameterValue("amplitude");
-    mAmpEnv.lengths()[0] = getInternalParameterValue("attackTime");
-    mAmpEnv.lengths()[2] = getInternalParameterValue("releaseTime");
     mPan.pos(getInternalParameterValue("pan"));
-    while (io())
+
+    // Pan is linear, so pan a unit sample once and apply the gains to the block
+    float gainL = 1, gainR;
+    mPan(gainL, gainL, gainR);
+
+    auto release = [&]
     {
-      float s1 = mAmpEnv() * (mOsc1() * a +
-                              mOsc3() * (a / 3.0) +
-                              mOsc5() * (a / 5.0) +
-                              mOsc7() * (a / 7.0));
-      float s2;
-      mPan(s1, s1, s2);
-      io.out(0) += s1;
-      io.out(1) += s2;
-    }
+      mAmpEnv.release(getInternalParameterValue("releaseTime"), gam::sampleRate());
+    };
+    audio::forEachChunk(io, mRelease.frame(*this, io), release, [&](int frame, int n)
+    {
+      float* s = audio::scratch(0);
+      audio::generate(s, mOsc, n);
+      float gain = a;
+      if (mAmpEnv.steady())
+        gain *= mAmpEnv.value(); // sustaining: the envelope is just a gain
+      else
+      {
+        float* env = audio::scratch(1);
+        mAmpEnv.generate(env, n);
+        audio::mul(s, env, n);
+      }
+      audio::panAdd(io.outBuffer(0) + frame, io.outBuffer(1) + frame, s,
+                    gainL * gain, gainR * gain, n);
+    });
     if (mAmpEnv.done())
       free();
   }
 
-  void onTriggerOn() override { mAmpEnv.reset(); }
-  void onTriggerOff() override { mAmpEnv.release(); }
+  void onTriggerOn() override
+  {
+    mOsc.bank(&audio::squareBank(gam::sampleRate()));
+    // Segment lengths are read when the segment starts
+    mAmpEnv.reset(getInternalParameterValue("attackTime"), gam::sampleRate());
+    mRelease.clear();
+  }
+  // Released from onProcess, on the frame the note-off was scheduled for
+  void onTriggerOff() override { mRelease.arm(); }
 };
 
 // We make an app.
@@ -96,6 +105,7 @@ public:
   {
     navControl().active(false); 
     gam::sampleRate(audioIO().framesPerSecond());
+    audio::squareBank(gam::sampleRate()); // build the shared tables up front
     imguiInit();
     synthManager.synthRecorder().verbose(true);
   }
@@ -203,7 +213,7 @@ public:
     return time+duration;
   }
 
-  float playChord(float time, Chord chord, float duration, bool roll=false){
+  float playChord(float time, const Chord& chord, float duration, bool roll=false){
       float localTime = 0;
       for(int i=0; i<chord.notes.size(); i++){
           playNote(time+localTime, chord.notes[i], duration, 0.05, 0.2, 0.75);
@@ -217,13 +227,13 @@ public:
     
     // Happy birthday uses: P1(C), M2(D), M3(E), P4(F), P5(G), M6(A), and m7(Bb)
     Scale majScale = Scale(root, scale_type::Major);
-    Note M2 = majScale.degree(scale_type::II);
-    Note M3 = majScale.degree(scale_type::III);
-    Note P4 = majScale.degree(scale_type::IV);
-    Note P5 = majScale.degree(scale_type::V);
-    Note M6 = majScale.degree(scale_type::VI);
+    Note M2 = majScale.degree(scale_degree::II);
+    Note M3 = majScale.degree(scale_degree::III);
+    Note P4 = majScale.degree(scale_degree::IV);
+    Note P5 = majScale.degree(scale_degree::V);
+    Note M6 = majScale.degree(scale_degree::VI);
     Note m7 = root.interval(interval_type::m7);
-    Note P8 = majScale.degree(scale_type::VIII);
+    Note P8 = majScale.degree(scale_degree::VIII);
 
     // For chords it needs: F Maj, C Dom7, Bb Maj, F/C (2nd inversion)
     // (Also dropping the root of the chord down an octave or Perfect Eighth)
@@ -5,7 +5,14 @@
 #include <stdio.h>
 #include <ostream>
 #include <assert.h>  
-#include <regex>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <string_view>
+#include <optional>
+#include <stdexcept>
+#include <cstdint>
+#include <unordered_map>
 
 /*------------------------------------------------------------
 
@@ -65,9 +72,9 @@ namespace theory
     };
 
     // Scale interval constants
-    const static int numScales = 37;
-    const static int maxScale = 13;
-    const static int scale_table[numScales][maxScale] = {
+    constexpr static int numScales = 37;
+    constexpr static int maxScale = 13;
+    constexpr static int scale_table[numScales][maxScale] = {
         {0,1,2,3,4,5,6,7,8,9,10,11,12},       // 0 Chromatic
         {0,2,3,5,7,8,10,12,-1,-1,-1,-1,-1},   // 1 Aeolian / Minor 
         {0,1,3,5,6,8,10,12,-1,-1,-1,-1,-1},   // 2 Locrian 
@@ -139,9 +146,9 @@ namespace theory
     enum chord_degree {
         root, third, fifth, seventh, ninth, eleventh, thirteenth, all
     };
-    const static int numChord = 7;
-    const static int maxChordLength = 7;
-    const static int chord_table[numChord][maxChordLength] = {
+    constexpr static int numChord = 7;
+    constexpr static int maxChordLength = 7;
+    constexpr static int chord_table[numChord][maxChordLength] = {
         {0, 4, 7, 11, 14, 17, 21}, // Major
         {0, 3, 7, 10, 14, 17, 20}, // Minor
         {0, 4, 8, 10, 15, 19, 23}, // Aug
@@ -167,8 +174,8 @@ namespace theory
         d2, d3, d4, d5, d6, d7, d8,
         A1, A2, A3, A4, A5, A6, A7
     };
-    const static int numIntervals = 26;
-    const static int interval_table[numIntervals] = {
+    constexpr static int numIntervals = 26;
+    constexpr static int interval_table[numIntervals] = {
         0, 5, 7, 12,          // Perfect
         1, 3, 8, 10,          // Minor
         2, 4, 9, 11,          // Major
@@ -199,78 +206,98 @@ namespace helper{
         int octave;
     };
 
-    struct parsed_chord 
+    // Fixed-size parse result used by the constexpr chord builders
+    // (key and bass are views into the parsed name)
+    struct chord_spec
     {
-        std::string key, bass;
-        std::vector<int> intervals; 
-        theory::chord_quality quality;
+        std::string_view key, bass, rest;
+        int intervals[theory::maxChordLength+1] = {};
+        int length = 0;
+        theory::chord_quality quality = theory::M;
+    };
+
+    // Error codes for the non-throwing note parser
+    enum class parse_error
+    {
+        none, empty, bad_note, too_long
     };
 
-    // Regexes for parsing notes
-    std::regex note_regex("[a-gA-G]");
-    std::regex sign_regex("[#nb]");
-    std::regex octave_regex("\\-1|[0-9]");
+    // Character classification for note names
+    constexpr static bool isNoteChar(char c){ return (c >= 'a' && c <= 'g') || (c >= 'A' && c <= 'G'); }
+    constexpr static bool isSignChar(char c){ return c == '#' || c == 'n' || c == 'b'; }
 
     // takes string input
-    // returns {note, sign, octave} if valid
-    static parsed_str parseString(std::string str)
+    // fills {note, sign, octave} and returns parse_error::none if valid
+    // (never allocates or throws)
+    constexpr static parse_error parseNote(std::string_view str, parsed_str& ret) noexcept
     {
-        std::string toParse = str;
-        parsed_str ret;
-
-        if(str.length() < 1 ){ throw std::out_of_range("Note(string) : input string ("+str+") is too short"); }
+        if(str.empty()){ return parse_error::empty; }
 
         // Make sure first character is a valid note letter
-        if(regex_match(toParse.substr(0,1), note_regex))
-        {
-            ret.note = toParse[0];
+        if(!isNoteChar(str[0])){ return parse_error::bad_note; }
+        ret.note = str[0];
+        ret.sign = 'n';
+        ret.octave = 4;
+        str.remove_prefix(1);
 
-            // If just a note, assume natural in 4th octave
-            if(toParse.length() == 1)
-            {
-                ret.sign = 'n';
-                ret.octave = 4;
-                return ret;
-            }
-            // Else, pop off front character
-            toParse = toParse.substr(1);
-        }
-        else{ throw std::out_of_range("Note(string) : input string ("+str+") is invalid (First char is not valid note)"); }
+        // If just a note, assume natural in 4th octave
+        if(str.empty()){ return parse_error::none; }
 
         // If there is a sign, save it and continue
-        if(regex_match(toParse.substr(0,1), sign_regex))
+        if(isSignChar(str[0]))
         {
-            ret.sign = toParse[0];
-            if(toParse.length() == 1)
-            {
-                ret.octave = 4;
-                return ret;
-            }
-            toParse = toParse.substr(1);
+            ret.sign = str[0];
+            str.remove_prefix(1);
+            if(str.empty()){ return parse_error::none; }
         }
 
-        // Do the same for the octave, except convert it to int
-        if(regex_match(toParse, octave_regex))
+        // Octave is either a single digit or -1
+        if(str.length() == 1 && str[0] >= '0' && str[0] <= '9')
         {
-            if(toParse[0] == '-')
-            {
-                ret.octave = -1*atoi(&toParse[1]);
-            }
-            else
-            {
-                ret.octave = atoi(&toParse[0]);
-            }
-            return ret;
+            ret.octave = str[0] - '0';
+            return parse_error::none;
+        }
+        if(str == "-1")
+        {
+            ret.octave = -1;
+            return parse_error::none;
+        }
+        return parse_error::too_long;
+    }
+
+    // takes string input
+    // returns {note, sign, octave} if valid, std::nullopt otherwise
+    constexpr static std::optional<parsed_str> tryParseString(std::string_view str) noexcept
+    {
+        parsed_str ret = {};
+        if(parseNote(str, ret) != parse_error::none){ return std::nullopt; }
+        return ret;
+    }
+
+    // takes string input
+    // returns {note, sign, octave} if valid, throws otherwise
+    constexpr static parsed_str parseString(std::string_view str)
+    {
+        parsed_str ret = {};
+        switch(parseNote(str, ret))
+        {
+            case parse_error::none:
+                return ret;
+            case parse_error::empty:
+                throw std::out_of_range("Note(string) : input string ("+std::string(str)+") is too short");
+            case parse_error::bad_note:
+                throw std::out_of_range("Note(string) : input string ("+std::string(str)+") is invalid (First char is not valid note)");
+            default:
+                throw std::out_of_range("Note(string) : input string ("+std::string(str)+") is too long");
         }
-        throw std::out_of_range("Note(string) : input string ("+str+") is too long");
     }
 
     // Takes key ( letter[+sign] )
     // Returns note index as # of semitones from A
-    static int noteIndex(std::string key)
+    constexpr static int noteIndex(std::string_view key)
     {
-        char letter = key[0];
-        int noteDist;
+        char letter = key.empty() ? '\0' : key[0];
+        int noteDist = 0;
         switch (letter)
         {
             case 'C': case 'c':
@@ -295,7 +322,7 @@ namespace helper{
                 noteDist = 2;
                 break;
             default:
-                throw std::out_of_range("Note(string) : input letter ("+key+") is not a note");
+                throw std::out_of_range("Note(string) : input letter ("+std::string(key)+") is not a note");
                 break;
         }
 
@@ -306,17 +333,17 @@ namespace helper{
             else if(key[1] == '#') noteDist += 1;
             return noteDist;
         }
-        throw std::out_of_range("Note(string) : input letter ("+key+") is not a note");
+        throw std::out_of_range("Note(string) : input letter ("+std::string(key)+") is not a note");
     }
 
     // takes parsed string input
     // returns midi index if valid
-    static int parsedToMidi(parsed_str parsed)
+    constexpr static int parsedToMidi(parsed_str parsed)
     {
         // Validate input
-        assert(regex_match(std::to_string(parsed.note), note_regex));
-        assert(regex_match(std::to_string(parsed.sign), sign_regex));
-        assert(parsed.octave > -1 && parsed.octave < 9);
+        assert(isNoteChar(parsed.note));
+        assert(isSignChar(parsed.sign));
+        assert(parsed.octave >= -1 && parsed.octave <= 9);
 
         // Determine octave distance from 4
         int octDist = (parsed.octave-4)*12;
@@ -358,7 +385,7 @@ namespace helper{
 
     // takes string input
     // returns Midi index if valid
-    static int stringToMidi(std::string str)
+    constexpr static int stringToMidi(std::string_view str)
     {
         parsed_str parsed = parseString(str);
         return parsedToMidi(parsed);
@@ -469,167 +496,295 @@ namespace helper{
 
     
 
-    // Fills in list of chord note intervals 
-    parsed_chord buildChordIntervals(parsed_chord chord, int length)
+    // Equal-tempered frequencies for every midi index, for one reference pitch (A4)
+    //  Entries use the same formula as the old per-call pow() path, so they are bit-identical
+    struct frequency_table
     {
-        for(int i=0; i<length; i++){
-            int interval = theory::chord_table[chord.quality][i];
-            if(interval >= 0) chord.intervals.push_back(interval);
+        constexpr static int numMidi = 128;
+
+        float root = 0;
+        float freq[numMidi] = {};
+
+        void build(float root)
+        {
+            double multiplier = pow(2.0, 1.0/12);
+            for(int i=0; i<numMidi; i++){
+                freq[i] = (float)(root*pow(multiplier, i - 69));
+            }
+            this->root = root;
         }
-        return chord;
+    };
+
+    // Frequency ratio for each whole cent in a semitone, 2^(cents/1200) for [0, 100]
+    inline const double* centRatios()
+    {
+        struct ratio_table
+        {
+            double ratio[101];
+            ratio_table(){ for(int c=0; c<=100; c++){ ratio[c] = pow(2.0, c/1200.0); } }
+        };
+        static const ratio_table table;
+        return table.ratio;
     }
 
-    // input: string chordName (e.g. "Cmaj7, Dbsus2")
-    // returns parsed_chord struct with root, quality, and a list of intervals
-    static parsed_chord parseChord(std::string name)
+    // returns frequency table for reference pitch (root)
+    //  A4 = 440 is built once, other references are kept in a small per-thread cache
+    //  (no locking or allocation on lookup)
+    inline const frequency_table& frequencyTable(float root=440.0)
     {
-        std::string str = name;
-        
-        // Key matching
-        std::regex key("^[a-gA-G]");
-        std::regex sign("^[bn#]");
-        
-        // Quality matching
-        std::regex major("^((maj)|(M))");
-        std::regex minor("^((min)|(m)|(-))");
-        std::regex dim("^((dim)|o)");
-        std::regex aug("^((aug)|(\\+)|(\\+5))");
-        
-        // Extensions, Alterations, Figured bass
-        std::regex extended("^(7|9|(11)|(13))");
-        std::regex alter("^([#b][59])");
-        std::regex add("^(add[24689])");
-        std::regex drop("^(add[24689])");
-        std::regex bass("^(\\/[a-gA-g][b#]?)");
-
-        std::smatch m;
-        parsed_chord chord;
-        int length = 0;
+        struct default_table : frequency_table { default_table(){ build(440.0); } };
+        static const default_table a440;
+        if(root == a440.root){ return a440; }
+
+        constexpr static int cacheSize = 4;
+        thread_local frequency_table cache[cacheSize];
+        thread_local int next = 0;
+        for(const frequency_table& table : cache){
+            if(table.root == root){ return table; }
+        }
+        frequency_table& table = cache[next];
+        next = (next+1) % cacheSize;
+        table.build(root);
+        return table;
+    }
 
-        // First, pop off key and sign
-        if(std::regex_search(str, m, key))
+    // takes (fractional) midi input, e.g. 69.25 = A4 + 25 cents
+    // returns frequency based on root
+    //  whole midi values are read straight from the table (bit-identical to pow)
+    //  fractional values interpolate a cent table, within 1 ULP (float) of the exact frequency
+    inline float midiToFrequency(float midi, float root=440.0)
+    {
+        int idx = (int)floor(midi);
+        if(idx < 0 || idx >= frequency_table::numMidi)
         {
-            chord.key = m.str();
-            str = m.suffix().str();
+            // outside the table, fall back to computing it directly
+            return (float)(root*pow(2.0, (midi - 69)/12.0));
         }
-        if(std::regex_search(str, m, sign))
+
+        const float base = frequencyTable(root).freq[idx];
+        double cents = (midi - idx) * 100.0;
+        if(cents == 0){ return base; }
+
+        int c = (int)cents;
+        const double* ratios = centRatios();
+        double ratio = ratios[c] + (ratios[c+1] - ratios[c]) * (cents - c);
+        return (float)(base * ratio);
+    }
+
+    // Chord symbol grammar tables, tried in order (first match wins)
+    struct chord_token
+    {
+        std::string_view text;
+        int value;
+    };
+
+    // Quality tokens (no match = dominant)
+    constexpr static chord_token quality_tokens[] = {
+        {"maj", theory::M}, {"M", theory::M},
+        {"min", theory::m}, {"m", theory::m}, {"-", theory::m},
+        {"aug", theory::aug}, {"+", theory::aug},
+        {"dim", theory::dim}, {"o", theory::dim},
+        {"sus2", theory::sus2}, {"sus4", theory::sus4},
+    };
+
+    // Extension tokens -> number of chord tones (no match = triad)
+    constexpr static chord_token extension_tokens[] = {
+        {"7", 4}, {"9", 5}, {"11", 6}, {"13", 7},
+    };
+
+    // Pops the first matching token off the front of str
+    // returns its value, or -1 if none match
+    template <size_t N>
+    constexpr static int popToken(std::string_view& str, const chord_token (&table)[N])
+    {
+        for(const chord_token& t : table)
         {
-            chord.key += m.str();
-            str = m.suffix().str();
+            if(str.substr(0, t.text.length()) == t.text)
+            {
+                str.remove_prefix(t.text.length());
+                return t.value;
+            }
         }
+        return -1;
+    }
+
+    // Appends an interval to a chord_spec
+    constexpr static void pushInterval(chord_spec& chord, int interval)
+    {
+        if(chord.length >= theory::maxChordLength+1){ throw std::out_of_range("Chord(string) : too many chord tones"); }
+        chord.intervals[chord.length++] = interval;
+    }
+
+    // input: string chordName (e.g. "Cmaj7, Dbsus2")
+    // returns chord_spec with root, quality, and a list of intervals
+    // (anything that could not be parsed is left in spec.rest)
+    constexpr static chord_spec parseChordSpec(std::string_view name)
+    {
+        std::string_view str = name;
+        chord_spec chord;
+
+        // First, pop off key and sign
+        size_t keyLength = 0;
+        if(!str.empty() && isNoteChar(str[0])){ keyLength++; }
+        if(str.length() > keyLength && isSignChar(str[keyLength])){ keyLength++; }
+        chord.key = str.substr(0, keyLength);
+        str.remove_prefix(keyLength);
 
         // Then determine quality
-        if(std::regex_search(str, m, major) || str.length()==0){
-            chord.quality = theory::M;
-            str = m.suffix().str();
-        }
-        else if(std::regex_search(str, m, minor)){
-            chord.quality = theory::m;
-            str = m.suffix().str();
-        }
-        else if(std::regex_search(str, m, aug)){
-            chord.quality = theory::aug;
-            str = m.suffix().str();
-        }
-        else if(std::regex_search(str, m, dim)){
-            chord.quality = theory::dim;
-            str = m.suffix().str();
-        }
-        else if(str.substr(0,4) == "sus2"){
-            chord.quality = theory::sus2;
-        }
-        else if(str.substr(0,4) == "sus4"){
-            chord.quality = theory::sus4;
-        }
-        else{
-            chord.quality = theory::dom;
-        }
+        int quality = str.empty() ? theory::M : popToken(str, quality_tokens);
+        chord.quality = (quality < 0) ? theory::dom : (theory::chord_quality)quality;
 
         // then check for extensions
-        if(std::regex_search(str, m, extended)){
-            int extend = std::stoi(m[0]);
-            if(extend == 7) length = 4;
-            if(extend == 9) length = 5;
-            if(extend == 11) length = 6;
-            if(extend == 13) length = 7;
-            str = m.suffix().str();
-        }
-        else{ length = 3; }
+        int length = popToken(str, extension_tokens);
+        if(length < 0){ length = 3; }
 
         // Build the base chord intervals
-        chord = buildChordIntervals(chord, length);
-        
+        for(int i=0; i<length; i++){
+            int interval = theory::chord_table[chord.quality][i];
+            if(interval >= 0) pushInterval(chord, interval);
+        }
+
         // Now look for alterations
-        if(std::regex_search(str, m, alter))
+        if(str.length() >= 2 && (str[0] == 'b' || str[0] == '#') && (str[1] == '5' || str[1] == '9'))
         {
-            if (m.str()[0] == 'b'){
-                if(m.str()[1] == '5'){ chord.intervals[theory::fifth] -= 1; }
-                if(m.str()[1] == '9') 
-                {
-                    // Add the ninth if it is not in chord
-                    if(chord.intervals.size() < 5)
-                    {
-                        chord.intervals.push_back(theory::chord_table[chord.quality][theory::ninth]);
-                    }
-                    chord.intervals[chord.intervals.size()-1] -= 1;
-                }
-            }
-            else if (m.str()[0] == '#')
+            int shift = (str[0] == 'b') ? -1 : 1;
+            if(str[1] == '5'){ chord.intervals[theory::fifth] += shift; }
+            else
             {
-                if(m.str()[1] == '5') { chord.intervals[theory::fifth] += 1; }
-                if(m.str()[1] == '9') 
+                // Add the ninth if it is not in chord
+                if(chord.length < 5)
                 {
-                    // Add the ninth if it is not in chord
-                    if(chord.intervals.size() < 5)
-                    {
-                        chord.intervals.push_back(theory::chord_table[chord.quality][theory::ninth]);
-                    }
-                    chord.intervals[chord.intervals.size()-1] += 1;
+                    pushInterval(chord, theory::chord_table[chord.quality][theory::ninth]);
                 }
+                chord.intervals[chord.length-1] += shift;
             }
-            str = m.suffix().str();
+            str.remove_prefix(2);
         }
-        
+
         // Then check for added tones
-        if(std::regex_search(str, m, add))
+        if(str.length() >= 4 && str.substr(0, 3) == "add")
         {
-            int add = std::stoi(m.str().substr(3,4));
-            int interval;
-            switch(add)
+            int interval = -1;
+            switch(str[3])
             {
-                case 2:
+                case '2':
                     interval = theory::chord_table[chord.quality][theory::ninth] - 12;
                     break;
-                case 4:
+                case '4':
                     interval = theory::chord_table[chord.quality][theory::eleventh] - 12;
                     break;
-                case 6:
+                case '6':
                     interval = theory::chord_table[chord.quality][theory::thirteenth] - 12;
                     break;
-                case 8:
+                case '8':
                     interval = 12;
                     break;
-                case 9:
+                case '9':
                     interval = theory::chord_table[chord.quality][theory::ninth];
                     break;
             }
-            chord.intervals.push_back(interval);
-            std::sort (chord.intervals.begin(), chord.intervals.end());
-            str = m.suffix().str();
+            if(interval != -1)
+            {
+                pushInterval(chord, interval);
+
+                // keep intervals sorted (insertion sort, usable at compile time)
+                for(int i=1; i<chord.length; i++){
+                    for(int j=i; j>0 && chord.intervals[j-1] > chord.intervals[j]; j--){
+                        int tmp = chord.intervals[j];
+                        chord.intervals[j] = chord.intervals[j-1];
+                        chord.intervals[j-1] = tmp;
+                    }
+                }
+                str.remove_prefix(4);
+            }
         }
 
         // If there is figured bass, record it
-        if(std::regex_search(str, m, bass))
+        if(str.length() >= 2 && str[0] == '/' && isNoteChar(str[1]))
         {
-            chord.bass = m.str().substr(1);
-            str = m.suffix().str();
+            size_t len = (str.length() >= 3 && (str[2] == 'b' || str[2] == '#')) ? 3 : 2;
+            chord.bass = str.substr(1, len-1);
+            str.remove_prefix(len);
         }
         else{ chord.bass = chord.key; }
 
-        // If string is not empty, chord is invalid
-        if(str.length() != 0){ throw std::out_of_range("Chord(string) : Chord ("+name+") is invalid, "+str+" was left over"); }
+        chord.rest = str;
         return chord;
-    }   
+    }
+
+    // Chord symbol cases checked at compile time (static_assert below)
+    //  expected values come from the std::regex parser parseChordSpec replaced
+    struct chord_spec_case
+    {
+        std::string_view name, key;
+        theory::chord_quality quality;
+        std::string_view bass, rest;
+        int length;
+        int intervals[theory::maxChordLength+1];
+    };
+
+    constexpr static chord_spec_case chord_spec_cases[] = {
+        {"C", "C", theory::M, "C", "", 3, {0,4,7}},
+        {"Cmaj", "C", theory::M, "C", "", 3, {0,4,7}},
+        {"CM", "C", theory::M, "C", "", 3, {0,4,7}},
+        {"Cm", "C", theory::m, "C", "", 3, {0,3,7}},
+        {"Cmin", "C", theory::m, "C", "", 3, {0,3,7}},
+        {"C-", "C", theory::m, "C", "", 3, {0,3,7}},
+        {"Caug", "C", theory::aug, "C", "", 3, {0,4,8}},
+        {"C+", "C", theory::aug, "C", "", 3, {0,4,8}},
+        {"Cdim", "C", theory::dim, "C", "", 3, {0,3,6}},
+        {"Co", "C", theory::dim, "C", "", 3, {0,3,6}},
+        {"C7", "C", theory::dom, "C", "", 4, {0,4,7,10}},
+        {"Cmaj7", "C", theory::M, "C", "", 4, {0,4,7,11}},
+        {"Cm7", "C", theory::m, "C", "", 4, {0,3,7,10}},
+        {"Cdim7", "C", theory::dim, "C", "", 4, {0,3,6,9}},
+        {"Caug7", "C", theory::aug, "C", "", 4, {0,4,8,10}},
+        {"C9", "C", theory::dom, "C", "", 5, {0,4,7,10,13}},
+        {"Cmaj9", "C", theory::M, "C", "", 5, {0,4,7,11,14}},
+        {"Cm11", "C", theory::m, "C", "", 6, {0,3,7,10,14,17}},
+        {"C13", "C", theory::dom, "C", "", 7, {0,4,7,10,13,17,20}},
+        {"Cmaj13", "C", theory::M, "C", "", 7, {0,4,7,11,14,17,21}},
+        {"Db7b5", "Db", theory::dom, "Db", "", 4, {0,4,6,10}},
+        {"F#m7#5", "F#", theory::m, "F#", "", 4, {0,3,8,10}},
+        {"G7b9", "G", theory::dom, "G", "", 5, {0,4,7,10,12}},
+        {"G7#9", "G", theory::dom, "G", "", 5, {0,4,7,10,14}},
+        {"Cb9", "Cb", theory::dom, "Cb", "", 5, {0,4,7,10,13}},
+        {"Am#9", "A", theory::m, "A", "", 4, {0,3,7,15}},
+        {"Cadd2", "C", theory::dom, "C", "", 4, {0,1,4,7}},
+        {"Cadd4", "C", theory::dom, "C", "", 4, {0,4,5,7}},
+        {"Cmadd6", "C", theory::m, "C", "", 4, {0,3,7,8}},
+        {"Cadd8", "C", theory::dom, "C", "", 4, {0,4,7,12}},
+        {"Cadd9", "C", theory::dom, "C", "", 4, {0,4,7,13}},
+        {"Cmaj7add9", "C", theory::M, "C", "", 5, {0,4,7,11,14}},
+        {"C/E", "C", theory::dom, "E", "", 3, {0,4,7}},
+        {"C/Eb", "C", theory::dom, "Eb", "", 3, {0,4,7}},
+        {"Cm7/Bb", "C", theory::m, "Bb", "", 4, {0,3,7,10}},
+        {"G7b9/F#", "G", theory::dom, "F#", "", 5, {0,4,7,10,12}},
+        {"Bbmaj9#5add6/D", "Bb", theory::M, "D", "", 6, {0,4,8,9,11,14}},
+        // differs from the regex parser on purpose: sus is consumed, the bass letter must be A-G
+        {"Csus2", "C", theory::sus2, "C", "", 3, {0,2,7}},
+        {"Csus4", "C", theory::sus4, "C", "", 3, {0,5,7}},
+        {"C/H", "C", theory::dom, "C", "/H", 3, {0,4,7}},
+        {"Cmaj7x", "C", theory::M, "C", "x", 4, {0,4,7,11}},
+    };
+
+    // returns the index of the first case parseChordSpec gets wrong, or -1
+    constexpr static int firstChordSpecMismatch()
+    {
+        int i = 0;
+        for(const chord_spec_case& c : chord_spec_cases)
+        {
+            chord_spec spec = parseChordSpec(c.name);
+            bool same = spec.key == c.key && spec.quality == c.quality && spec.bass == c.bass &&
+                        spec.rest == c.rest && spec.length == c.length;
+            for(int n=0; same && n<c.length; n++){ same = spec.intervals[n] == c.intervals[n]; }
+            if(!same){ return i; }
+            i++;
+        }
+        return -1;
+    }
+
+    static_assert(firstChordSpecMismatch() == -1, "parseChordSpec disagrees with chord_spec_cases");
 }
 
 namespace theory {
@@ -639,51 +794,201 @@ namespace theory {
     class Note 
     {
         public:
-            int index;
-            char signPref;
-
-            Note(char note='A', char sign='n', int octave=4, char signPref='b');
-            Note(std::string input, char signPref='n');
-            Note(int midi, char signPref='b');
-
-            std::string name();
-            std::string key();
-            int         midi();
-            float       frequency(float root=440.0);
-            int         octave();
-            int         distanceTo(Note* b);
-
-            void set(int midi, char signPref='b');
-            void set(std::string input, char signPref='n');
-            void set(char key='A', char sign='n', int octave=4, char signPref='b');
-
-            bool setOctave(int octave=4);
+            // midi index [0-127] and spelling preference ('b' or '#'), 2 bytes total
+            uint8_t index = 69;
+            char signPref = 'b';
+
+            constexpr Note(char note='A', char sign='n', int octave=4, char signPref='b');
+            constexpr Note(std::string_view input, char signPref='n');
+            constexpr Note(int midi, char signPref='b');
+
+            std::string   name() const;
+            std::string   key() const;
+            constexpr int midi() const;
+            float         frequency(float root=440.0) const;
+            float         detune(float cents, float root=440.0) const;
+            constexpr int octave() const;
+            constexpr int distanceTo(const Note* b) const;
+
+            constexpr void set(int midi, char signPref='b');
+            constexpr void set(std::string_view input, char signPref='n');
+            constexpr void set(char key='A', char sign='n', int octave=4, char signPref='b');
+
+            constexpr bool setOctave(int octave=4);
             bool setKey(std::string key);
             bool setKey(char key, char sign);
 
-            Note octaveUp(int num=1);
-            Note octaveDown(int num=1);
+            constexpr Note octaveUp(int num=1) const;
+            constexpr Note octaveDown(int num=1) const;
 
-            Note  interval(interval_type type, int direction=1);
-            Note  interval(int semitones);
+            constexpr Note interval(interval_type type, int direction=1) const;
+            constexpr Note interval(int semitones) const;
             Chord chord(std::string chord_name, int octave=3);
             Scale scale(scale_type type);
 
         private:
-            void init(int midi, char signPref);
+            constexpr void init(int midi, char signPref);
+    };
+
+    static_assert(sizeof(Note) == 2, "Note should pack into 2 bytes");
+
+    // Fixed-capacity list of notes that can be built in constant expressions
+    template <int N>
+    struct note_array
+    {
+        static_assert(N <= 255, "note_array count is stored in one byte");
+
+        Note data[N] = {};
+        uint8_t count = 0;
+
+        constexpr int  size() const { return count; }
+        constexpr bool empty() const { return count == 0; }
+        constexpr void push_back(Note n)
+        {
+            if(count >= N){ throw std::out_of_range("note_array : capacity ("+std::to_string(N)+") exceeded"); }
+            data[count++] = n;
+        }
+
+        constexpr void clear() { count = 0; }
+
+        constexpr Note&       operator[](int i)       { return data[i]; }
+        constexpr const Note& operator[](int i) const { return data[i]; }
+        constexpr Note&       front()       { return data[0]; }
+        constexpr const Note& front() const { return data[0]; }
+        constexpr Note&       back()        { return data[count-1]; }
+        constexpr const Note& back()  const { return data[count-1]; }
+        constexpr Note*       begin()       { return data; }
+        constexpr Note*       end()         { return data + count; }
+        constexpr const Note* begin() const { return data; }
+        constexpr const Note* end()   const { return data + count; }
     };
 
     typedef std::vector<Note> notelist;
 
+    // Chord tones are stored inline (longest chord + one added tone), so chords never allocate
+    typedef note_array<maxChordLength+1> chordlist;
+    static_assert(sizeof(chordlist) == sizeof(Note)*(maxChordLength+1)+1, "chordlist should hold notes with no padding");
+
+    // Compile-time counterparts of Chord and Scale
+    //  (convert implicitly to Chord / Scale when runtime objects are needed)
+    struct chord_literal
+    {
+        chordlist notes;
+        chord_quality quality = M;
+    };
+
+    struct scale_literal
+    {
+        note_array<maxScale> notes;
+        scale_type type = Chromatic;
+    };
+
+    // 12-bit set of pitch classes (bit 0 = C, bit 11 = B)
+    //  membership, transposition, union and intersection are single bit operations
+    class PitchSet
+    {
+        public:
+            constexpr static uint16_t mask = 0xFFF;
+            uint16_t bits = 0;
+
+            constexpr PitchSet(uint16_t bits=0) : bits(bits & mask) {}
+
+            // pitch class of a midi index (or any interval, wraps octaves)
+            constexpr static int pitchClass(int midi){ return ((midi % 12) + 12) % 12; }
+
+            constexpr bool contains(int pc) const { return (bits >> pitchClass(pc)) & 1; }
+            constexpr bool contains(const Note& n) const { return contains(n.midi()); }
+            constexpr bool contains(PitchSet other) const { return (bits & other.bits) == other.bits; }
+
+            constexpr PitchSet with(int pc) const { return PitchSet(bits | (1 << pitchClass(pc))); }
+            constexpr PitchSet with(const Note& n) const { return with(n.midi()); }
+
+            // rotates every pitch class up by (semitones)
+            constexpr PitchSet transpose(int semitones) const
+            {
+                int n = pitchClass(semitones);
+                return PitchSet((uint16_t)((bits << n) | (bits >> (12 - n))));
+            }
+
+            // number of pitch classes in set
+            constexpr int size() const
+            {
+                int count = 0;
+                for(uint16_t b = bits; b; b &= (b - 1)){ count++; }
+                return count;
+            }
+            constexpr bool empty() const { return bits == 0; }
+
+            constexpr PitchSet operator|(PitchSet other) const { return PitchSet(bits | other.bits); }
+            constexpr PitchSet operator&(PitchSet other) const { return PitchSet(bits & other.bits); }
+            constexpr PitchSet operator^(PitchSet other) const { return PitchSet(bits ^ other.bits); }
+            constexpr PitchSet operator~() const { return PitchSet(~bits); }
+            constexpr bool operator==(PitchSet other) const { return bits == other.bits; }
+            constexpr bool operator!=(PitchSet other) const { return bits != other.bits; }
+
+            // set of any list of notes (e.g. chord.notes, scale.notes)
+            template <class List>
+            constexpr static PitchSet of(const List& notes)
+            {
+                PitchSet set;
+                for(const Note& n : notes){ set = set.with(n); }
+                return set;
+            }
+
+            // set of a scale type, built from scale_table
+            constexpr static PitchSet ofScale(scale_type type, int root=0)
+            {
+                PitchSet set;
+                for(int i=0; i<maxScale; i++){
+                    if(scale_table[type][i] >= 0){ set = set.with(scale_table[type][i]); }
+                }
+                return set.transpose(root);
+            }
+
+            // set of a chord quality with (length) tones, built from chord_table
+            constexpr static PitchSet ofChord(chord_quality quality, int length=3, int root=0)
+            {
+                PitchSet set;
+                for(int i=0; i<length && i<maxChordLength; i++){
+                    if(chord_table[quality][i] >= 0){ set = set.with(chord_table[quality][i]); }
+                }
+                return set.transpose(root);
+            }
+    };
+
+    // Precomputed pitch sets for every scale type on every root
+    //  e.g. scale_sets.set[Dorian][2] = D Dorian
+    struct scale_set_table
+    {
+        PitchSet set[numScales][12] = {};
+
+        constexpr scale_set_table()
+        {
+            for(int type=0; type<numScales; type++){
+                for(int root=0; root<12; root++){
+                    set[type][root] = PitchSet::ofScale((scale_type)type, root);
+                }
+            }
+        }
+    };
+    constexpr static scale_set_table scale_sets{};
+
+    struct scale_match
+    {
+        scale_type type;
+        int root; // pitch class of tonic (C=0)
+    };
+
     class Chord
     {
         public:
-            notelist notes;
+            chordlist notes;
             chord_quality quality;
 
-            Chord(std::string name, int octave=3);
-            Chord(Note* root, std::string name, int octave=3);
+            Chord(std::string_view name, int octave=3);
+            Chord(Note* root, std::string_view name, int octave=3);
             Chord(std::vector<int> idxs);
+            Chord(const chord_literal& literal);
 
             Note root();
             Note third();
@@ -696,15 +1001,17 @@ namespace theory {
             void invert(int inversion=1);
             void drop(chord_degree degree=all);
             void raise(chord_degree degree=all);
-            void match(Chord source);
+            void match(const Chord& source);
 
             std::vector<int> indexes();
 
-            float score();
+            float score() const;
             void sort();
-        
-        private:
-            void init(helper::parsed_chord parsed, int octave=3);
+
+            PitchSet pitches() const;
+
+            static std::string_view identify(const int* midi, size_t n);
+            static void voiceLead(Chord* chords, size_t n);
     };
 
     class Scale{
@@ -714,6 +1021,7 @@ namespace theory {
 
             Scale(Note tonic, scale_type type);
             Scale(std::string tonic, scale_type type);
+            Scale(const scale_literal& literal);
 
             Note degree(scale_degree degree);
             Note degree(int degree);
@@ -721,9 +1029,12 @@ namespace theory {
 
             Chord chord(scale_degree degree, int size=3);
             Chord chord(int degree, int size=3);
+
+            PitchSet pitches() const;
+            bool contains(const Note& note) const;
+            bool contains(const Chord& chord) const;
         
         private:
-            void init(Note tonic, scale_type type);
             Chord buildChord(int degree, int size);
     };
 
@@ -732,53 +1043,59 @@ namespace theory {
 // ------------------------------------------------------------------ 
 
         // Constructors
-        Note::Note(std::string input, char signPref){ this->set(input, signPref); }
+        constexpr Note::Note(std::string_view input, char signPref){ this->set(input, signPref); }
 
-        Note::Note(int midi, char signPref){ init(midi, signPref); }
+        constexpr Note::Note(int midi, char signPref){ init(midi, signPref); }
 
-        Note::Note(char note, char sign, int octave, char signPref)
+        constexpr Note::Note(char note, char sign, int octave, char signPref)
         { 
             helper::parsed_str parsed = {note, sign, octave};
             init(helper::parsedToMidi(parsed), signPref);
         }
         
         // Main initializer
-        void Note::init(int midi, char signPref)
+        constexpr void Note::init(int midi, char signPref)
         {
             if(midi > 127 || midi <0){ throw std::out_of_range("Note(midi) : midi index ("+std::to_string(midi)+") is out of range"); }
-            this->index = midi;
+            this->index = (uint8_t)midi;
             this->signPref = signPref;
         }
 
         // returns full note name (e.g. "Db6")
-        std::string Note::name(){ return helper::midiToString(this->index, this->signPref); }
+        std::string Note::name() const { return helper::midiToString(this->index, this->signPref); }
 
         // returns key without octave (e.g. "Db")
-        std::string Note::key(){ return helper::midiToString(this->index, this->signPref, false); }
+        std::string Note::key() const { return helper::midiToString(this->index, this->signPref, false); }
 
         // returns midi index
-        int Note::midi(){ return this->index; }
+        constexpr int Note::midi() const { return this->index; }
 
         // returns frequency (based on root)
-        float Note::frequency(float root)
+        float Note::frequency(float root) const
         {
-            int distance = this->index - 69;
-            double multiplier = pow(2.0, 1.0/12);
+            static_assert(helper::frequency_table::numMidi == 128, "frequency table should cover midi [0-127]");
+            // index is a plain byte, so guard the table read (computed directly past it)
+            if(this->index >= helper::frequency_table::numMidi){ return helper::midiToFrequency(this->index, root); }
+            return helper::frequencyTable(root).freq[this->index];
+        }
 
-            return (float)(root*pow(multiplier, distance));
+        // returns frequency detuned by (cents), e.g. detune(-50) is a quarter tone flat
+        float Note::detune(float cents, float root) const
+        {
+            return helper::midiToFrequency(this->index + cents/100.0f, root);
         }
 
         // returns octave [-1, 9]
-        int Note::octave()
+        constexpr int Note::octave() const
         {
             return (this->midi()/12)-1;
         }
 
         // set note to new midi index [0-127]
-        void Note::set(int midi, char signPref){ init(midi, signPref); }
+        constexpr void Note::set(int midi, char signPref){ init(midi, signPref); }
 
         // set note to new string name
-        void Note::set(std::string input, char signPref)
+        constexpr void Note::set(std::string_view input, char signPref)
         { 
             helper::parsed_str parsed = helper::parseString(input);
             int idx = helper::parsedToMidi(parsed);
@@ -791,19 +1108,20 @@ namespace theory {
         }
         
         // set note to new key, sign, and octave
-        void Note::set(char key, char sign, int octave, char signPref)
+        constexpr void Note::set(char key, char sign, int octave, char signPref)
         { 
             helper::parsed_str parsed = {key, sign, octave};
             init(helper::parsedToMidi(parsed), signPref);
         }
 
         // set octave of note without changing key
-        bool Note::setOctave(int octave)
+        constexpr bool Note::setOctave(int octave)
         {
             if(octave < -1 || octave > 9) return false;
             int noteIdx = this->index%12;
             int offset = (octave+1)*12;
-            this->index = noteIdx + offset;
+            if(noteIdx + offset > 127) return false;   // e.g. A#9, B9
+            this->index = (uint8_t)(noteIdx + offset);
 
             return true;
         }
@@ -825,18 +1143,18 @@ namespace theory {
         }
 
         // returns note at octave intervals above
-        Note Note::octaveUp(int num){ return Note(this->index+(12*num)); }
+        constexpr Note Note::octaveUp(int num) const { return Note(this->index+(12*num)); }
 
         // returns note at octave intervals above
-        Note Note::octaveDown(int num){ return Note((this->index)-(12*num)); }
+        constexpr Note Note::octaveDown(int num) const { return Note((this->index)-(12*num)); }
 
         // returns distance (in semitones) to another note
-        int Note::distanceTo(Note* b){ return b->midi() - this->index; }
+        constexpr int Note::distanceTo(const Note* b) const { return b->midi() - this->index; }
 
         // returns note at specified interval above/below current note
         // direction = 1 for up
         // direction = -1 for down
-        Note Note::interval(interval_type type, int direction)
+        constexpr Note Note::interval(interval_type type, int direction) const
         {
             int interval = interval_table[type] * direction;
             Note n = Note(index + interval);
@@ -844,63 +1162,109 @@ namespace theory {
         }
 
         // returns note at specified interval above/below current note
-        Note Note::interval(int semitones)
+        constexpr Note Note::interval(int semitones) const
         {
             Note n = Note(index + semitones);
             return n;
         }
 
 // ------------------------------------------------------------------
-//      Chord methods
+//      Compile-time chord and scale builders
 // ------------------------------------------------------------------ 
 
-        // constructors
-        Chord::Chord(std::string name, int octave)
+        // Builds the notes of a parsed chord on rootIdx, 
+        // rotating the figured bass (if any) to the bottom
+        constexpr chord_literal buildChord(const helper::chord_spec& spec, int rootIdx)
         {
-            helper::parsed_chord parsed = helper::parseChord(name);
-            init(parsed, octave);
+            chord_literal chord;
+            chord.quality = spec.quality;
+
+            for(int i=0; i<spec.length; i++)
+            {
+                chord.notes.push_back(Note(rootIdx + spec.intervals[i]));
+            }
+
+            if(spec.bass != spec.key && spec.bass.length() > 0)
+            {
+                // noteIndex is relative to A, convert to pitch class (C=0)
+                int bassNote = (helper::noteIndex(spec.bass) + 21) % 12;
+                int bassIdx = -1;
+                for(int i=0; i<chord.notes.size(); i++)
+                {
+                    if(chord.notes[i].midi() % 12 == bassNote){ bassIdx = i; }
+                }
+
+                if(bassIdx == -1){ throw std::out_of_range("Chord(string) : Figured bass ("+std::string(spec.bass)+") is not in chord"); }
+                for(int i=0; i<bassIdx; i++)
+                {
+                    Note first = chord.notes[0];
+                    for(int j=1; j<chord.notes.size(); j++){ chord.notes[j-1] = chord.notes[j]; }
+                    chord.notes[chord.notes.size()-1] = first;
+                }
+
+                // notes below the bass move up by octaves (while there is room) so the bass ends up lowest
+                int bassMidi = chord.notes[0].midi();
+                for(int i=1; i<chord.notes.size(); i++)
+                {
+                    int raised = chord.notes[i].midi();
+                    while(raised < bassMidi && raised + 12 <= 127){ raised += 12; }
+                    chord.notes[i] = Note(raised, chord.notes[i].signPref);
+                }
+            }
+            return chord;
         }
 
-        Chord::Chord(Note* root, std::string name, int octave)
+        // Returns chord with type (name), e.g. makeChord("Dmin11")
+        constexpr chord_literal makeChord(std::string_view name, int octave=3)
         {
-            helper::parsed_chord parsed = helper::parseChord(name);
-            parsed.key = root->key();
-            init(parsed, octave);
+            helper::chord_spec spec = helper::parseChordSpec(name);
+            if(spec.rest.length() != 0){ throw std::out_of_range("Chord(string) : Chord ("+std::string(name)+") is invalid, "+std::string(spec.rest)+" was left over"); }
+
+            Note root = Note(spec.key);
+            root.setOctave(octave);
+            return buildChord(spec, root.midi());
         }
 
-        Chord::Chord(std::vector<int> idxs)
+        // Returns chord with root and type (name), e.g. makeChord(note, "dim7")
+        constexpr chord_literal makeChord(Note root, std::string_view name, int octave=3)
         {
-            for(int idx: idxs){ notes.push_back(Note(idx)); }
+            helper::chord_spec spec = helper::parseChordSpec(name);
+            if(spec.rest.length() != 0){ throw std::out_of_range("Chord(string) : Chord ("+std::string(name)+") is invalid, "+std::string(spec.rest)+" was left over"); }
+
+            root.setOctave(octave);
+            return buildChord(spec, root.midi());
         }
 
-        void Chord::init(helper::parsed_chord parsed, int octave)
+        // Returns scale of (type) starting on tonic
+        constexpr scale_literal makeScale(Note tonic, scale_type type)
         {
-            Note root = Note(parsed.key);
-            quality = parsed.quality;
-            
-            root.setOctave(octave);
-            int rootIdx = root.midi();
+            scale_literal scale;
+            scale.type = type;
 
-            for(int interval:parsed.intervals)
-            {
-                notes.push_back(Note(rootIdx + interval));
+            // variable length scales, fixed length array, filled space with -1s
+            for(int i=0; i<maxScale; i++){
+                int interval = scale_table[type][i];
+                if(interval >= 0){ scale.notes.push_back(Note(tonic.index + interval)); }
             }
+            return scale;
+        }
 
-            if(parsed.bass != parsed.key && parsed.bass.length() > 0)
-            {
-                int bassNote = helper::noteIndex(parsed.bass);
-                int bassIdx = -1;
-                for(int i=0; i<notes.size(); i++)
-                {
-                    int noteLoc = helper::noteIndex(notes[i].key());
-                    if(noteLoc == bassNote){ bassIdx = i; }
-                }
+// ------------------------------------------------------------------
+//      Chord methods
+// ------------------------------------------------------------------ 
 
-                if(bassIdx == -1){ throw std::out_of_range("Chord(string) : Figured bass ("+parsed.bass+") is not in chord"); }
-                else{ this->invert(bassIdx); }
-            }
+        // constructors
+        Chord::Chord(std::string_view name, int octave) : Chord(makeChord(name, octave)) {}
+
+        Chord::Chord(Note* root, std::string_view name, int octave) : Chord(makeChord(*root, name, octave)) {}
+
+        Chord::Chord(std::vector<int> idxs)
+        {
+            for(int idx: idxs){ notes.push_back(Note(idx)); }
         }
 
+        Chord::Chord(const chord_literal& literal) : notes(literal.notes), quality(literal.quality) {}
+
         // Returns chord with root (this) and type (name)
         Chord Note::chord(std::string name, int octave){ return Chord(this, name, octave); }
 
@@ -1032,68 +1396,187 @@ namespace theory {
             return sum;
         }
 
-        float Chord::score()
+        float Chord::score() const
         {
             int sum = 0.0;
-            for(Note n : notes){
+            for(const Note& n : notes){
                 sum += n.midi();
             }
             return sum / notes.size();
         }
 
-        // Attempts to match average pitch of this chord to source chord 
-        void Chord::match(Chord dest)
+// ------------------------------------------------------------------
+//      Voice leading
+// ------------------------------------------------------------------ 
+
+    // Sorted (ascending) midi indexes of one chord voicing
+    struct voicing
+    {
+        int midi[maxChordLength+1] = {};
+        char sign[maxChordLength+1] = {};  // each voice's spelling preference, kept through revoicing
+        int size = 0;
+        int sum = 0;
+
+        float mean() const { return size ? (float)sum / size : 0; }
+    };
+
+    namespace voice_leading
+    {
+        // Candidate voicings per chord: every inversion, at the two octaves closest to the center
+        constexpr static int maxCandidates = 2*(maxChordLength+1);
+
+        // returns sorted voicing of chord tones (chords are small, insertion sort)
+        inline voicing fromNotes(const chordlist& notes)
+        {
+            voicing v;
+            for(const Note& n : notes){
+                int i = v.size++;
+                for(; i>0 && v.midi[i-1] > n.midi(); i--){ v.midi[i] = v.midi[i-1]; v.sign[i] = v.sign[i-1]; }
+                v.midi[i] = n.midi();
+                v.sign[i] = n.signPref;
+                v.sum += n.midi();
+            }
+            return v;
+        }
+
+        // inversion (k) of sorted voicing v (bottom k notes up an octave), moved by (octaves)
+        // the two sorted runs are merged, so the result stays sorted without re-sorting
+        // returns false if any note leaves the midi range
+        inline bool invert(const voicing& v, int k, int octaves, voicing& out)
         {
-            float destScore = dest.score();
-            float score = this->score();
-            float dist = score - destScore;
-            float newScore, newDist;
-            float threshold = (12.0/notes.size())+2;
-            while(abs(dist) > threshold){
-                if(dist > threshold) {
-                    int i= notes.size()-1;
-                    Note dropped = notes[i].octaveDown();
-                    newScore = (this->score() - notes[i].index + dropped.index) / notes.size();
-                    newDist = newScore - destScore;
-                    if(newDist > dist) break;
-                    else notes[i] = dropped;
-                    this->sort();
+            int shift = 12*octaves;
+            int hi = k, lo = 0;
+            out.size = v.size;
+            out.sum = v.sum + 12*k + shift*v.size;
+            for(int i=0; i<v.size; i++){
+                int upper = (hi < v.size) ? v.midi[hi] : 1 << 20;
+                int raised = (lo < k) ? v.midi[lo] + 12 : 1 << 20;
+                if(upper <= raised){ out.midi[i] = upper + shift; out.sign[i] = v.sign[hi]; hi++; }
+                else{ out.midi[i] = raised + shift; out.sign[i] = v.sign[lo]; lo++; }
+                if(out.midi[i] < 0 || out.midi[i] > 127){ return false; }
+            }
+            return true;
+        }
+
+        // minimal total semitone motion between two sorted voicings
+        //  voices move in order (no crossing); when sizes differ, voices split or merge
+        inline int motion(const voicing& a, const voicing& b)
+        {
+            constexpr int N = maxChordLength+1;
+            int cost[N][N];
+            for(int i=0; i<a.size; i++){
+                for(int j=0; j<b.size; j++){
+                    int best = 0;
+                    if(i > 0 && j > 0){ best = std::min(cost[i-1][j-1], std::min(cost[i-1][j], cost[i][j-1])); }
+                    else if(i > 0){ best = cost[i-1][j]; }
+                    else if(j > 0){ best = cost[i][j-1]; }
+                    cost[i][j] = best + abs(a.midi[i] - b.midi[j]);
                 }
-                else if(dist < -1*threshold){
-                    Note raised = notes[0].octaveUp();
-                    newScore = (this->score() - notes[0].index + raised.index) / notes.size();
-                    newDist = newScore - destScore;
-                    if(newDist > dist) break;
-                    else notes[0] = raised;
-                    this->sort();
+            }
+            return cost[a.size-1][b.size-1];
+        }
+
+        // fills out[] with candidate voicings of v near (center), returns count
+        inline int candidates(const voicing& v, float center, voicing* out)
+        {
+            int count = 0;
+            for(int k=0; k<v.size; k++){
+                // octave that puts this inversion's mean closest to center, and its neighbour
+                float mean = (float)(v.sum + 12*k) / v.size;
+                float octaves = (center - mean) / 12.0f;
+                int nearest = (int)floor(octaves + 0.5f);
+                int other = (octaves > nearest) ? nearest+1 : nearest-1;
+                for(int o : {nearest, other}){
+                    if(invert(v, k, o, out[count])){ count++; }
                 }
-                score = this->score();
-                dist = score - destScore;
             }
+            return count;
         }
 
-        
+        inline void assign(Chord& chord, const voicing& v)
+        {
+            chord.notes.clear();
+            for(int i=0; i<v.size; i++){ chord.notes.push_back(Note(v.midi[i], v.sign[i])); }
+        }
+    }
 
-// ------------------------------------------------------------------
-//      Scale methods
-// ------------------------------------------------------------------ 
-        void Scale::init(Note tonic, scale_type type)
+        // Revoices this chord (inversion + octave) for the least total motion from dest
+        void Chord::match(const Chord& dest)
         {
-            this->type = type;
-            
-            // loop through chord intervals to build list of notes
-            for(int i=0; i<maxScale; i++){
-                int interval = scale_table[type][i];
-                if(interval >= 0 ){ // variable length scales, fixed length array, filled space with -1s
-                    int idx = tonic.index + interval;
-                    Note cnote = Note(idx);
-                    notes.push_back(cnote);
+            if(notes.empty() || dest.notes.empty()){ return; }
+
+            voicing target = voice_leading::fromNotes(dest.notes);
+            voicing options[voice_leading::maxCandidates];
+            int count = voice_leading::candidates(voice_leading::fromNotes(notes), target.mean(), options);
+
+            int best = -1, bestCost = 0;
+            for(int i=0; i<count; i++){
+                int cost = voice_leading::motion(options[i], target);
+                if(best < 0 || cost < bestCost){ best = i; bestCost = cost; }
+            }
+            if(best >= 0){ voice_leading::assign(*this, options[best]); }
+        }
+
+        // Revoices a whole progression for the least total motion, in one pass.
+        //  The first chord stays as is; every later chord picks an inversion and octave
+        //  near the first chord's register (dynamic programming over the candidates).
+        void Chord::voiceLead(Chord* chords, size_t n)
+        {
+            using namespace voice_leading;
+            if(n < 2 || chords[0].notes.empty()){ return; }
+
+            float center = fromNotes(chords[0].notes).mean();
+
+            // cost of the best path ending in each candidate, and where it came from
+            voicing prev[maxCandidates], curr[maxCandidates];
+            int prevCost[maxCandidates], currCost[maxCandidates];
+            std::vector<uint8_t> from(n * maxCandidates, 0);
+
+            prev[0] = fromNotes(chords[0].notes);
+            prevCost[0] = 0;
+            int prevCount = 1;
+
+            for(size_t c=1; c<n; c++){
+                int count = chords[c].notes.empty() ? 0 : candidates(fromNotes(chords[c].notes), center, curr);
+                if(count == 0){
+                    // nothing to revoice, carry the previous voicings through
+                    for(int i=0; i<prevCount; i++){ from[c*maxCandidates + i] = (uint8_t)i; }
+                    continue;
                 }
-            } 
+                for(int i=0; i<count; i++){
+                    currCost[i] = -1;
+                    for(int j=0; j<prevCount; j++){
+                        int cost = prevCost[j] + motion(prev[j], curr[i]);
+                        if(currCost[i] < 0 || cost < currCost[i]){
+                            currCost[i] = cost;
+                            from[c*maxCandidates + i] = (uint8_t)j;
+                        }
+                    }
+                }
+                std::copy(curr, curr + count, prev);
+                std::copy(currCost, currCost + count, prevCost);
+                prevCount = count;
+            }
+
+            // walk back through the cheapest path (candidates are rebuilt, they are deterministic)
+            int state = (int)(std::min_element(prevCost, prevCost + prevCount) - prevCost);
+            for(size_t c=n-1; c>0; c--){
+                if(!chords[c].notes.empty()){
+                    voicing options[maxCandidates];
+                    candidates(fromNotes(chords[c].notes), center, options);
+                    assign(chords[c], options[state]);
+                }
+                state = from[c*maxCandidates + state];
+            }
         }
 
-        Scale::Scale(Note tonic, scale_type type){ init(tonic, type);}
-        Scale::Scale(std::string tonic, scale_type type){ init(Note(tonic), type); }
+// ------------------------------------------------------------------
+//      Scale methods
+// ------------------------------------------------------------------ 
+        Scale::Scale(Note tonic, scale_type type) : Scale(makeScale(tonic, type)) {}
+        Scale::Scale(std::string tonic, scale_type type) : Scale(makeScale(Note(tonic), type)) {}
+        Scale::Scale(const scale_literal& literal)
+            : notes(literal.notes.begin(), literal.notes.end()), type(literal.type) {}
 
         Note Scale::degree(scale_degree degree){ return notes[degree]; }
 
@@ -1108,14 +1591,289 @@ namespace theory {
         Chord Scale::buildChord(int degree, int size)
         {
             int idx = degree;
-            std::vector<int> chordNotes;
+            chord_literal chordNotes;
             for(int i=0; i<size; i++){
-                chordNotes.push_back(notes[idx].midi());
+                chordNotes.notes.push_back(notes[idx]);
                 idx = (idx+2)%notes.size();
             }
             return Chord(chordNotes);
         }
 
+        // returns set of pitch classes in scale (read from scale_sets)
+        PitchSet Scale::pitches() const
+        {
+            if(notes.empty()){ return PitchSet(); }
+            return scale_sets.set[type][PitchSet::pitchClass(notes[0].midi())];
+        }
+
+        // returns true if note (in any octave) is in scale
+        bool Scale::contains(const Note& note) const { return pitches().contains(note); }
+
+        // returns true if every chord tone (in any octave) is in scale
+        bool Scale::contains(const Chord& chord) const { return pitches().contains(chord.pitches()); }
+
+// ------------------------------------------------------------------
+//      Pitch set queries
+// ------------------------------------------------------------------ 
+
+        // returns set of pitch classes in chord
+        PitchSet Chord::pitches() const { return PitchSet::of(notes); }
+
+        // returns every (scale type, root) that contains all pitch classes in set
+        //  e.g. scalesContaining(Chord("Dmin11").pitches())
+        inline std::vector<scale_match> scalesContaining(PitchSet set)
+        {
+            std::vector<scale_match> ret;
+            for(int type=0; type<numScales; type++){
+                for(int root=0; root<12; root++){
+                    if(scale_sets.set[type][root].contains(set)){ ret.push_back({(scale_type)type, root}); }
+                }
+            }
+            return ret;
+        }
+
+// ------------------------------------------------------------------
+//      Progression
+// ------------------------------------------------------------------ 
+
+    // Chord progression parsed in one call, stored as a struct of arrays
+    //  e.g. Progression::parse("Dmin11 | Gmin7 | Ebmin11 C#dim7")
+    //  chords are separated by whitespace, bars by '|'
+    //  repeated symbols are parsed once and their notes copied
+    class Progression
+    {
+        public:
+            std::vector<std::string> symbols;       // distinct chord symbols, in first-seen order
+
+            // one entry per chord
+            std::vector<uint32_t> symbolIndex;      // index into symbols
+            std::vector<uint32_t> barIndex;         // bar number (from 0)
+            std::vector<uint8_t> roots;             // root midi index
+            std::vector<chord_quality> qualities;
+            std::vector<uint32_t> offsets;          // chord i tones are midi[offsets[i]] to midi[offsets[i+1]-1]
+
+            std::vector<uint8_t> midi;              // every chord tone, contiguous
+
+            size_t size() const { return symbolIndex.size(); }
+            size_t bars() const { return barIndex.empty() ? 0 : barIndex.back() + 1; }
+            int length(size_t i) const { return offsets[i+1] - offsets[i]; }
+            const uint8_t* notes(size_t i) const { return midi.data() + offsets[i]; }
+
+            Chord chord(size_t i) const;
+
+            static Progression parse(std::string_view text, int octave=3);
+    };
+
+        // returns chord (i) as a Chord object (no parsing)
+        Chord Progression::chord(size_t i) const
+        {
+            chord_literal literal;
+            literal.quality = qualities[i];
+            for(uint32_t n=offsets[i]; n<offsets[i+1]; n++){ literal.notes.push_back(Note(midi[n])); }
+            return Chord(literal);
+        }
+
+        Progression Progression::parse(std::string_view text, int octave)
+        {
+            Progression prog;
+            prog.offsets.push_back(0);
+
+            // distinct symbols, keyed by views into text
+            std::unordered_map<std::string_view, uint32_t> interned;
+            std::vector<chord_literal> built;
+            std::vector<uint8_t> builtRoots;
+
+            uint32_t bar = 0;
+            size_t pos = 0;
+            while(pos < text.length())
+            {
+                char c = text[pos];
+                if(c == '|')
+                {
+                    // empty bars count, leading bar lines do not
+                    if(prog.size() > 0 || bar > 0){ bar++; }
+                    pos++;
+                    continue;
+                }
+                if(isspace((unsigned char)c)){ pos++; continue; }
+
+                size_t start = pos;
+                while(pos < text.length() && text[pos] != '|' && !isspace((unsigned char)text[pos])){ pos++; }
+                std::string_view name = text.substr(start, pos - start);
+
+                uint32_t id;
+                auto found = interned.find(name);
+                if(found != interned.end()){ id = found->second; }
+                else
+                {
+                    helper::chord_spec spec = helper::parseChordSpec(name);
+                    if(spec.rest.length() != 0){ throw std::out_of_range("Progression(string) : Chord ("+std::string(name)+") is invalid, "+std::string(spec.rest)+" was left over"); }
+
+                    Note root = Note(spec.key);
+                    root.setOctave(octave);
+
+                    id = (uint32_t)built.size();
+                    built.push_back(buildChord(spec, root.midi()));
+                    builtRoots.push_back((uint8_t)root.midi());
+                    prog.symbols.emplace_back(name);
+                    interned.emplace(name, id);
+                }
+
+                const chord_literal& literal = built[id];
+                prog.symbolIndex.push_back(id);
+                prog.barIndex.push_back(bar);
+                prog.roots.push_back(builtRoots[id]);
+                prog.qualities.push_back(literal.quality);
+                for(const Note& n : literal.notes){ prog.midi.push_back(n.index); }
+                prog.offsets.push_back((uint32_t)prog.midi.size());
+            }
+            return prog;
+        }
+
+// ------------------------------------------------------------------
+//      Chord identification
+// ------------------------------------------------------------------ 
+
+    // Lookup table from (pitch class set, bass pitch class) to chord symbol
+    //  Built once from the chord grammar (every symbol is run through parseChordSpec,
+    //  so a name always means what Chord(name) builds). Lookups never allocate.
+    class ChordIndex
+    {
+        public:
+            ChordIndex(){ build(); }
+
+            // returns chord symbol, or an empty view if the set is not a known chord
+            std::string_view find(PitchSet set, int bass) const
+            {
+                uint32_t slot = slots[key(set, bass)];
+                if(slot == 0){ return std::string_view(); }
+                const symbol& sym = symbols[slot-1];
+                return std::string_view(names.data() + sym.offset, sym.length);
+            }
+
+            // number of distinct (set, bass) entries
+            size_t size() const { return symbols.size(); }
+
+            // Grammar pieces, simplest first (earlier names win on collisions)
+            constexpr static const char* qualities[]    = {"", "m", "maj", "dim", "aug", "sus2", "sus4"};
+            constexpr static const char* extensions[]   = {"", "7", "9", "11", "13"};
+            constexpr static const char* alterations[]  = {"", "b5", "#5", "b9", "#9"};
+            constexpr static const char* adds[]         = {"", "add2", "add4", "add6", "add9"};
+
+        private:
+            struct symbol
+            {
+                uint32_t offset;
+                uint8_t length;
+            };
+
+            std::vector<uint32_t> slots = std::vector<uint32_t>(1 << 16, 0); // 12 bit set + 4 bit bass
+            std::vector<symbol> symbols;
+            std::string names;
+
+            static int key(PitchSet set, int bass){ return set.bits | (PitchSet::pitchClass(bass) << 12); }
+
+            // adds name for (set, bass) unless a simpler name was added first
+            void insert(PitchSet set, int bass, const std::string& name)
+            {
+                uint32_t& slot = slots[key(set, bass)];
+                if(slot != 0){ return; }
+                symbols.push_back({(uint32_t)names.size(), (uint8_t)name.length()});
+                names += name;
+                slot = (uint32_t)symbols.size();
+            }
+
+            void build()
+            {
+                // Root position: tiers are plain, altered, added, altered + added
+                for(int tier=0; tier<4; tier++){
+                    for(const char* alter : alterations){
+                        if((*alter != 0) != (tier & 1)){ continue; }
+                        for(const char* add : adds){
+                            if((*add != 0) != ((tier >> 1) & 1)){ continue; }
+                            for(const char* ext : extensions){
+                                for(const char* quality : qualities){
+                                    for(int root=0; root<12; root++){
+                                        std::string name = helper::midiToString(root + 60, 'b', false) + quality + ext + alter + add;
+                                        helper::chord_spec spec = helper::parseChordSpec(name);
+                                        if(spec.rest.length() != 0 || spec.key.empty()){ continue; }
+
+                                        // the parsed key is the real root (e.g. "C"+"b5" parses as Cb)
+                                        int rootPc = PitchSet::pitchClass(helper::noteIndex(spec.key) + 9);
+                                        PitchSet set;
+                                        bool valid = true;
+                                        for(int i=0; i<spec.length; i++){
+                                            // negative intervals come from the -1 padding in chord_table (e.g. sus + add2)
+                                            if(spec.intervals[i] < 0){ valid = false; }
+                                            set = set.with(rootPc + spec.intervals[i]);
+                                        }
+                                        if(valid){ insert(set, rootPc, name); }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+
+                // Slash chords: every other chord tone in the bass
+                size_t rootSymbols = symbols.size();
+                for(int k=0; k<(1 << 16); k++){
+                    if(slots[k] == 0 || slots[k] > rootSymbols){ continue; }
+                    PitchSet set((uint16_t)(k & PitchSet::mask));
+                    int rootPc = k >> 12;
+                    const symbol sym = symbols[slots[k]-1];
+                    std::string name = names.substr(sym.offset, sym.length);
+                    for(int pc=0; pc<12; pc++){
+                        if(pc == rootPc || !set.contains(pc)){ continue; }
+                        insert(set, pc, name + "/" + helper::midiToString(pc + 60, 'b', false));
+                    }
+                }
+            }
+    };
+
+    // returns the shared chord index (built on first call, call once at startup
+    // to keep the build off the audio thread)
+    inline const ChordIndex& chordIndex()
+    {
+        static const ChordIndex index;
+        return index;
+    }
+
+        // returns chord symbol (e.g. "Bbm7b5", "F/C") for a list of midi notes,
+        // lowest note is the bass. Returns an empty view if no chord matches.
+        std::string_view Chord::identify(const int* midi, size_t n)
+        {
+            if(n == 0){ return std::string_view(); }
+            PitchSet set;
+            int bass = midi[0];
+            for(size_t i=0; i<n; i++){
+                set = set.with(midi[i]);
+                if(midi[i] < bass){ bass = midi[i]; }
+            }
+            return chordIndex().find(set, bass);
+        }
+
+// ------------------------------------------------------------------
+//      Literals
+//          "C#4"_note, "Dmin11"_chord
+//          (evaluated at compile time when used in constant expressions)
+// ------------------------------------------------------------------ 
+    inline namespace literals
+    {
+        constexpr Note operator""_note(const char* str, size_t len){ return Note(std::string_view(str, len)); }
+        constexpr chord_literal operator""_chord(const char* str, size_t len){ return makeChord(std::string_view(str, len)); }
+    }
+
+    static_assert("A4"_note.midi() == 69, "A4 should be midi 69");
+    static_assert("C#4"_note.midi() == 61 && "C#4"_note.signPref == '#', "C#4 should be midi 61, spelled with sharps");
+    static_assert(Note(60).interval(P5).midi() == 67, "P5 above C4 should be G4");
+    static_assert("Dmin11"_chord.notes.size() == 6 && "Dmin11"_chord.notes[5].midi() == 67, "Dmin11 should be D3 F3 A3 C4 E4 G4");
+    static_assert("F/C"_chord.notes[0].midi() == 60 && "F/C"_chord.notes[2].midi() == 69, "F/C should be C4 F4 A4");
+    static_assert(!Note("A#4").setOctave(9) && Note("G4").setOctave(9), "setOctave should stop at G9 (midi 127)");
+    static_assert(makeScale("C4"_note, Minor).notes[2].midi() == 63, "third of C minor should be Eb4");
+    static_assert(PitchSet::of("Dmin11"_chord.notes) == PitchSet::ofChord(m, 6, 2), "Dmin11 pitch set should match chord_table");
+    static_assert(scale_sets.set[Major][0].transpose(2) == scale_sets.set[Major][2], "transposing C major by 2 should give D major");
+
     
 // ------------------------------------------------------------------
 //     Tempo Class
@@ -1158,6 +1916,8 @@ namespace theory {
                 this->barLength = beatLength*(4.0/sigBottom)*sigTop;
             }
 
+            Tempo(float bpm, timeSignature sig) : Tempo(bpm, sig.top, sig.bottom) {}
+
             float duration(note_type type, bool dot=false){
                 float duration = note_length[type] * beatLength;
                 if(dot) duration *= 1.5;
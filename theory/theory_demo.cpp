@@ -1,4 +1,10 @@
+#include <chrono>
 #include <cstdio> // for printing to stdout
+#include <iostream>
+#include <new>
+#include <random>
+#include <regex>
+#include <string>
 
 #include "Gamma/Analysis.h"
 #include "Gamma/Effects.h"
@@ -13,12 +19,30 @@
 #include "al/ui/al_Parameter.hpp"
 
 #include "theoryOne.h"
+#include "audioTools.h"
 
 
 // using namespace gam;
 using namespace al;
 using namespace theory;
 
+// Heap allocations made by a thread while its counting flag is set
+// (--bench); array and nothrow new go through this operator new
+namespace alloc_check
+{
+  std::atomic<long> count{0};
+  thread_local bool counting = false;
+}
+
+void *operator new(std::size_t size)
+{
+  if (alloc_check::counting) alloc_check::count++;
+  if (void *p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
 // This example shows how to use SynthVoice and SynthManagerto create an audio
 // visual synthesizer. In a class that inherits from SynthVoice you will
 // define the synth's voice parameters and the sound and graphic generation
@@ -29,22 +53,15 @@ class SquareWave : public SynthVoice
 public:
   // Unit generators
   gam::Pan<> mPan;
-  gam::Sine<> mOsc1;
-  gam::Sine<> mOsc3;
-  gam::Sine<> mOsc5;
-  gam::Sine<> mOsc7;
+  audio::WavetableOsc mOsc; // odd harmonics 1-7, band-limited per octave
 
-  gam::Env<3> mAmpEnv;
+  audio::LinearEnvelope mAmpEnv; // attack, sustain, release
+  audio::ReleasePoint mRelease;  // note-off frame within the block
 
   // Initialize voice. This function will only be called once per voice when
   // it is created. Voices will be reused if they are idle.
   void init() override
   {
-    // Intialize envelope
-    mAmpEnv.curve(0); // make segments lines
-    mAmpEnv.levels(0, 1, 1, 0);
-    mAmpEnv.sustainPoint(2); // Make point 2 sustain until a release is issued
-
     createInternalTriggerParameter("amplitude", 0.8, 0.0, 1.0);
     createInternalTriggerParameter("frequency", 440, 20, 5000);
     createInternalTriggerParameter("attackTime", 0.1, 0.01, 3.0);
@@ -62,27 +79,35 @@ public:
     // Parameters will update values once per audio callback because they
     // are outside the sample processing loop.
     float f = getInternalParameterValue("frequency");
-    mOsc1.freq(f);
-    mOsc3.freq(f * 3);
-    mOsc5.freq(f * 5);
-    mOsc7.freq(f * 7);
+    mOsc.freq(f);
 
     float a = getInternalParameterValue("amplitude");
-    mAmpEnv.lengths()[0] = getInternalParameterValue("attackTime");
-    mAmpEnv.lengths()[2] = getInternalParameterValue("releaseTime");
     mPan.pos(getInternalParameterValue("pan"));
-    while (io())
+
+    // Pan is linear, so pan a unit sample once and apply the gains to the block
+    float gainL = 1, gainR;
+    mPan(gainL, gainL, gainR);
+
+    auto release = [&]
     {
-      float s1 = mAmpEnv() * (mOsc1() * a +
-                              mOsc3() * (a / 3.0) +
-                              mOsc5() * (a / 5.0) +
-                              mOsc7() * (a / 7.0));
-
-      float s2;
-      mPan(s1, s1, s2);
-      io.out(0) += s1;
-      io.out(1) += s2;
-    }
+      mAmpEnv.release(getInternalParameterValue("releaseTime"), gam::sampleRate());
+    };
+    audio::forEachChunk(io, mRelease.frame(*this, io), release, [&](int frame, int n)
+    {
+      float* s = audio::scratch(0);
+      audio::generate(s, mOsc, n);
+      float gain = a;
+      if (mAmpEnv.steady())
+        gain *= mAmpEnv.value(); // sustaining: the envelope is just a gain
+      else
+      {
+        float* env = audio::scratch(1);
+        mAmpEnv.generate(env, n);
+        audio::mul(s, env, n);
+      }
+      audio::panAdd(io.outBuffer(0) + frame, io.outBuffer(1) + frame, s,
+                    gainL * gain, gainR * gain, n);
+    });
     // We need to let the synth know that this voice is done
     // by calling the free(). This takes the voice out of the
     // rendering chain
@@ -93,8 +118,15 @@ public:
   // The triggering functions just need to tell the envelope to start or release
   // The audio processing function checks when the envelope is done to remove
   // the voice from the processing chain.
-  void onTriggerOn() override { mAmpEnv.reset(); }
-  void onTriggerOff() override { mAmpEnv.release(); }
+  void onTriggerOn() override
+  {
+    mOsc.bank(&audio::squareBank(gam::sampleRate()));
+    // Segment lengths are read when the segment starts
+    mAmpEnv.reset(getInternalParameterValue("attackTime"), gam::sampleRate());
+    mRelease.clear();
+  }
+  // Released from onProcess, on the frame the note-off was scheduled for
+  void onTriggerOff() override { mRelease.arm(); }
 };
 
 // We make an app.
@@ -105,6 +137,12 @@ public:
   // The name provided determines the name of the directory
   // where the presets and sequences are stored
   SynthGUIManager<SquareWave> synthManager{"SquareWave"};
+
+  // Notes queued by playNote, submitted as one sorted batch per key press
+  // and triggered by the scheduler on the audio thread
+  audio::EventScheduler scheduler;
+  std::vector<audio::note_event> batch;
+  audio::CallbackMonitor callbacks; // Audio callback overruns ('v' prints)
   
   // This function is called right after the window is created
   // It provides a grphics context to initialize ParameterGUI
@@ -115,8 +153,7 @@ public:
     navControl().active(false); // Disable navigation via keyboard, since we
                                 // will be using keyboard for note triggering
 
-    // Set sampling rate for Gamma objects from app's audio
-    gam::sampleRate(audioIO().framesPerSecond());
+    setupAudio(audioIO().framesPerSecond());
 
     imguiInit();
 
@@ -127,10 +164,29 @@ public:
     synthManager.synthRecorder().verbose(true);
   }
 
+  // Shared by live and offline rendering
+  void setupAudio(double sampleRate)
+  {
+    // Set sampling rate for Gamma objects from app's audio
+    gam::sampleRate(sampleRate);
+    audio::squareBank(sampleRate); // build the shared tables up front
+    batch.reserve(1024);
+  }
+
+  // Hands everything queued so far to the scheduler in one batch
+  void flushNotes()
+  {
+    scheduler.submit(batch);
+    batch.clear();
+  }
+
   // The audio callback function. Called when audio hardware requires data
   void onSound(AudioIOData &io) override
   {
+    callbacks.begin();
+    scheduler.render(io, synthManager.synth()); // Start and release due notes
     synthManager.render(io); // Render audio
+    callbacks.end(io);
   }
 
   void onAnimate(double dt) override
@@ -161,14 +217,21 @@ public:
       // keyboard
       return true;
     }
+    bool result = handleKey(k.key());
+    flushNotes();
+    return result;
+  }
 
-    Scale scale = Scale("C4", theory::Minor);
-    Chord chord1 = Chord("Cmaj");
-    Chord chord2 = Chord("Emaj");
-    Chord chord3 = Chord("G7");
-    Chord chord4 = Chord("Bm");
+  // Key handling, also used to queue notes for offline renders
+  bool handleKey(int key)
+  {
+    // Built at compile time, so a key press only copies them
+    constexpr chord_literal chord1 = "Cmaj"_chord;
+    constexpr chord_literal chord2 = "Emaj"_chord;
+    constexpr chord_literal chord3 = "G7"_chord;
+    constexpr chord_literal chord4 = "Bm"_chord;
 
-    switch (k.key())
+    switch (key)
     {
     case 'a':
       noteDemo();
@@ -190,13 +253,21 @@ public:
       playChord(0, chord4, 1.0);
       return false;
     case '5':
-      chord2.match(chord1);
-      chord3.match(chord1);
-      chord4.match(chord1);
+    {
+      Chord matched2 = chord2;
+      Chord matched3 = chord3;
+      Chord matched4 = chord4;
+      matched2.match(chord1);
+      matched3.match(chord1);
+      matched4.match(chord1);
       playChord(0, chord1, 1.0);
-      playChord(1, chord2, 1.0);
-      playChord(2, chord3, 1.0);
-      playChord(3, chord4, 1.0);
+      playChord(1, matched2, 1.0);
+      playChord(2, matched3, 1.0);
+      playChord(3, matched4, 1.0);
+      return false;
+    }
+    case 'v':
+      printStats();
       return false;
     
     
@@ -219,6 +290,34 @@ public:
 
   void onExit() override { imguiShutdown(); }
 
+  void printStats()
+  {
+    auto &s = scheduler.stats;
+    std::cout << "scheduler: " << s.started << " started, " << s.late
+              << " late (worst " << s.maxLateFrames << " frames), " << s.dropped
+              << " dropped; callbacks: " << callbacks.overruns << " overruns in "
+              << callbacks.blocks << " blocks, peak load " << callbacks.peakLoad
+              << std::endl;
+  }
+
+  // Renders what the given keys play without an audio device and writes
+  // it to a WAV file ('a' waits for enter between steps, so use the others)
+  int renderToFile(const char *path, const audio::render_settings &settings, const std::string &keys)
+  {
+    setupAudio(settings.sampleRate);
+    for (char key : keys)
+      handleKey(key);
+    flushNotes();
+
+    auto samples = audio::renderOffline(settings, [&](AudioIOData &io) { onSound(io); });
+    if (!audio::writeWav(path, samples, settings.channels, settings.sampleRate))
+    {
+      std::cerr << "could not write " << path << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
   // New code: a function to play a note A
 
   float playNote(float time, Note note, float duration = 0.5, float amp = 0.1, bool fullDuration=false)
@@ -236,12 +335,12 @@ public:
     }
     // amp, freq, attack, release, pan
     voice->setTriggerParams({amp, note.frequency(), 0.1, 0.1, 0.0});
-    synthManager.synthSequencer().addVoiceFromNow(voice, time, dur); 
+    batch.push_back({voice, time, dur});
 
     return time+duration;
   }
 
-  float playChord(float time, Chord chord, float duration, float roll=0){
+  float playChord(float time, const Chord& chord, float duration, float roll=0){
       float localTime = 0;
       for(int i=0; i<chord.notes.size(); i++){
           playNote(time+localTime, chord.notes[i], duration, 0.05);
@@ -253,37 +352,34 @@ public:
   }
 
   void playProgression(){
-    Chord c1 = Chord("Dmin11");
-    Chord c2 = Chord("Gmin7");
-    Chord c3 = Chord("Ebmin11");
-    Chord c4 = Chord("C#dim7");
-    c4.raise();
+    // Parsed in one call, the repeated Dmin11 is only parsed once
+    Progression prog = Progression::parse("Dmin11 | Gmin7 | Dmin11 | Ebmin11 C#dim7");
 
     theory::Tempo tpo(80, (Tempo::timeSignature){4,4});
     float dottedHalf = tpo.duration(Tempo::half, true);
-    float sixteenth = tpo.duration(Tempo::sixteenth);
     float quarter = tpo.duration(Tempo::quarter);
 
     float time=0;
-
-    time = playChord(time, c1, dottedHalf);
-    time += quarter; // One beat rest
-
-    time = playChord(time, c2, dottedHalf);
-    time += quarter; 
-
-    time = playChord(time, c1, dottedHalf);
-    time += quarter; // One beat rest
-
-    time = playChord(time, c3, dottedHalf/2);
-
-    time = playChord(time, c4, dottedHalf/2);
-    time += quarter;
+    size_t i=0;
+    for(size_t bar=0; bar<prog.bars(); bar++){
+      // Chords in a bar share a dotted half, then one beat rest
+      size_t first = i;
+      while(i < prog.size() && prog.barIndex[i] == bar) i++;
+      for(size_t c=first; c<i; c++){
+        time = playChord(time, prog.chord(c), dottedHalf/(i-first));
+      }
+      time += quarter;
+    }
+  }
 
 
+  // Plays what has been queued, then waits for enter
+  void waitForEnter()
+  {
+    flushNotes();
+    system("read");
   }
 
-
   void noteDemo(){
     // Tempo constructor takes bpm and time signature, or bpm, timesig top, timesig bottom
     theory::Tempo tpo(80, (Tempo::timeSignature){4,4}); 
@@ -307,7 +403,7 @@ public:
     time = playNote(time, note1, quarter);
     
     std::cout << "press enter to continue" << std::endl;
-    system("read");
+    waitForEnter();
     time=0;
 
     // To build on this note, you can grab notes that are "musically related" with scales and intervals
@@ -320,7 +416,7 @@ public:
       time = playNote(time, n, quarter); 
     }
 
-    system("read"); // waits for user
+    waitForEnter(); // waits for user
     time=0;
 
     // We can move notes by semitone, interval, or octave
@@ -330,7 +426,7 @@ public:
       time = playNote(time, n.interval(theory::P4), quarter);
     }
     
-    system("read");
+    waitForEnter();
     time=0;
 
     // Or drop the note by an octave
@@ -339,7 +435,7 @@ public:
       time = playNote(time, n.octaveDown(), quarter);
     }
     
-    system("read");
+    waitForEnter();
     time=0;
 
     // We can also use note objects to build chords
@@ -363,13 +459,13 @@ public:
     time = playChord(time, chord3, dottedHalf, sixteenth);
     time += quarter; 
 
-    system("read");
+    waitForEnter();
     time=0;
 
     // That second one is quite a bit higher than the other two,
-    // so we can 'roll' the pitch down to try and match the first
-    //    i.e. invert the chord by shifting the highest note down an octave
-    //          until the average pitch is as close to the destination chord
+    // so we can revoice it to sit closer to the first
+    //    i.e. try every inversion at the octaves nearest the first chord
+    //          and keep the one where the voices move the fewest semitones
     Chord chord2copy = Chord(chord2);
     chord2copy.match(chord1);
 
@@ -378,13 +474,13 @@ public:
     time = playChord(time, chord2, half);
     
     time += quarter;
-    system("read");
+    waitForEnter();
     time=0;
 
     // Then matched
     time = playChord(time, chord1, half);
     time = playChord(time, chord2copy, half);
-    system("read");
+    waitForEnter();
     time=0;
 
     // We can also invert the chord (move the bottom note to the top)
@@ -392,7 +488,7 @@ public:
     Chord chord4 = Chord("F");
     chord4.invert(2);
     time = playChord(time, chord4, half);
-    system("read");
+    waitForEnter();
     time=0;
 
     // When translating sheet music, chords are often specified with "figured bass"
@@ -408,11 +504,232 @@ public:
 
   
 
-int main()
+// Checks that need a running program (the compile-time ones are
+// static_asserts in theoryOne.h). Returns the number of failures.
+int selfTest()
 {
+  int failures = 0;
+  auto check = [&](bool ok, const std::string &what)
+  {
+    if (!ok)
+    {
+      if (failures < 20) std::cerr << "FAIL " << what << std::endl;
+      failures++;
+    }
+  };
+
+  // Chord::identify round trip: every spelling the chord index is built
+  // from, on every root and over every bass, must be named back as the
+  // same pitch set over the same bass
+  const char *keys[] = {"C", "Db", "D", "Eb", "E", "F", "F#", "G", "Ab", "A", "Bb", "B"};
+  int checked = 0;
+  for (const char *key : keys)
+    for (const char *quality : ChordIndex::qualities)
+      for (const char *ext : ChordIndex::extensions)
+        for (const char *alter : ChordIndex::alterations)
+          for (const char *add : ChordIndex::adds)
+            for (int bass = -1; bass < 12; bass++)
+            {
+              std::string name = std::string(key) + quality + ext + alter + add;
+              if (bass >= 0) name += std::string("/") + keys[bass];
+
+              // skip what the grammar rejects, as the index does
+              helper::chord_spec spec = helper::parseChordSpec(name);
+              if (spec.rest.length() != 0) continue;
+              bool valid = true;
+              for (int i = 0; i < spec.length; i++) valid = valid && spec.intervals[i] >= 0;
+              if (!valid) continue;
+              chord_literal chord;
+              try { chord = makeChord(name); }
+              catch (const std::out_of_range &) { continue; } // bass not in chord
+
+              int midi[maxChordLength + 1];
+              int n = chord.notes.size();
+              for (int i = 0; i < n; i++) midi[i] = chord.notes[i].midi();
+              std::string_view found = Chord::identify(midi, n);
+              checked++;
+
+              bool same = !found.empty();
+              if (same)
+              {
+                chord_literal back = makeChord(found);
+                same = PitchSet::of(back.notes) == PitchSet::of(chord.notes) &&
+                       PitchSet::pitchClass(back.notes[0].midi()) == PitchSet::pitchClass(midi[0]);
+              }
+              check(same, "identify(" + name + ") = \"" + std::string(found) + "\"");
+            }
+  std::cout << "identify round trip: " << checked << " chords" << std::endl;
+
+  if (failures) std::cout << "self test failed: " << failures << " failures" << std::endl;
+  else std::cout << "self test passed" << std::endl;
+  return failures ? 1 : 0;
+}
+
+// Earlier implementations, kept only as baselines for --bench
+namespace baseline
+{
+  // Note name parsing before helper::parseNote: regex_match on substrings
+  helper::parsed_str regexParse(std::string str)
+  {
+    static const std::regex note_regex("[a-gA-G]");
+    static const std::regex sign_regex("[#nb]");
+    static const std::regex octave_regex("\\-1|[0-9]");
+    std::string toParse = str;
+    helper::parsed_str ret;
+    ret.sign = 'n';
+    ret.octave = 4;
+    if (str.length() < 1 || !regex_match(toParse.substr(0, 1), note_regex)) throw std::out_of_range(str);
+    ret.note = toParse[0];
+    if (toParse.length() == 1) return ret;
+    toParse = toParse.substr(1);
+    if (regex_match(toParse.substr(0, 1), sign_regex))
+    {
+      ret.sign = toParse[0];
+      if (toParse.length() == 1) return ret;
+      toParse = toParse.substr(1);
+    }
+    if (!regex_match(toParse, octave_regex)) throw std::out_of_range(str);
+    ret.octave = toParse[0] == '-' ? -atoi(&toParse[1]) : atoi(&toParse[0]);
+    return ret;
+  }
+
+  // Chord::match before minimal-motion voice leading: moves the top note
+  // down or the bottom note up an octave until the (integer) mean pitch is
+  // near dest's. v stays sorted.
+  void greedyMatch(voicing &v, const voicing &dest)
+  {
+    auto mean = [](const voicing &c) { return (float)(c.sum / c.size); };
+    float destScore = mean(dest);
+    float dist = mean(v) - destScore;
+    float threshold = (12.0f / v.size) + 2;
+    while (std::abs(dist) > threshold)
+    {
+      int i = dist > threshold ? v.size - 1 : 0;
+      int moved = v.midi[i] + (dist > threshold ? -12 : 12);
+      float newDist = (mean(v) - v.midi[i] + moved) / v.size - destScore;
+      if (newDist > dist) break;
+      v.sum += moved - v.midi[i];
+      v.midi[i] = moved;
+      std::sort(v.midi, v.midi + v.size);
+      dist = mean(v) - destScore;
+    }
+  }
+}
+
+// Times reps calls of fn(), returns nanoseconds per call
+template <class Fn>
+double nsPerCall(long reps, Fn &&fn)
+{
+  auto begin = std::chrono::steady_clock::now();
+  for (long i = 0; i < reps; i++) fn();
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / reps;
+}
+
+// Micro-benchmarks for the theory library, printed one line each
+int bench()
+{
+  volatile int sink = 0; // keeps results live
+
+  // Note names: every letter, sign and octave spelling
+  std::vector<std::string> names;
+  for (char letter : std::string("abcdefgABCDEFG"))
+    for (std::string sign : {"", "#", "b", "n"})
+      for (std::string octave : {"", "-1", "0", "1", "2", "3", "4", "5", "6", "7", "8", "9"})
+        names.push_back(letter + sign + octave);
+  size_t next = 0;
+  auto name = [&]() -> const std::string & { next = next + 1 == names.size() ? 0 : next + 1; return names[next]; };
+  double parsed = nsPerCall(2000000, [&] { sink = sink + helper::tryParseString(name())->octave; });
+  double regex = nsPerCall(100000, [&] { sink = sink + baseline::regexParse(name()).octave; });
+  printf("note parsing: %.1f ns per name (regex baseline %.1f ns), %zu names\n", parsed, regex, names.size());
+
+  // Chords: build a progression, copy it and revoice each chord against
+  // the one before; Chord keeps its notes inline, so none of it allocates
+  alloc_check::count = 0;
+  alloc_check::counting = true;
+  Chord chords[] = {Chord("Dmin11"), Chord("Gmin7"), Chord("Ebmin11"), Chord("C#dim7")};
+  Chord copies[] = {chords[0], chords[1], chords[2], chords[3]};
+  for (int i = 1; i < 4; i++) copies[i].match(copies[i - 1]);
+  alloc_check::counting = false;
+  long allocations = alloc_check::count;
+  double matched = nsPerCall(1000000, [&] {
+    Chord chord = chords[next = (next + 1) % 4];
+    chord.match(chords[(next + 3) % 4]);
+    sink = sink + chord.notes[0].midi();
+  });
+  printf("chords: %ld heap allocations building, copying and matching 4 chords; %.1f ns per copy + match\n",
+         allocations, matched);
+
+  // Chord symbols from midi notes: the index is built on first use
+  double built = nsPerCall(1, [] { chordIndex(); });
+  int held[][4] = {{53, 57, 60, 64}, {48, 53, 57, 60}, {50, 53, 57, 60}, {55, 59, 62, 65}};
+  double identified = nsPerCall(2000000, [&] {
+    sink = sink + (int)Chord::identify(held[next = (next + 1) % 4], 4).size();
+  });
+  printf("identify: %.1f ms to build the chord index, %.1f ns per lookup\n", built / 1e6, identified);
+
+  // Voice leading over a random progression, in total semitones of motion
+  // between neighbouring chords
+  const char *roots[] = {"C", "Db", "D", "Eb", "E", "F", "F#", "G", "Ab", "A", "Bb", "B"};
+  const char *kinds[] = {"", "m", "7", "m7", "maj7", "dim7", "m7b5", "9", "min11", "sus4", "add9", "7#5"};
+  std::mt19937 rng(1);
+  std::vector<Chord> progression;
+  for (int i = 0; i < 10000; i++)
+  {
+    std::string name = roots[rng() % 12];
+    progression.push_back(Chord(name + kinds[rng() % 12]));
+  }
+  auto motion = [](const std::vector<Chord> &chords) {
+    long total = 0;
+    for (size_t i = 1; i < chords.size(); i++)
+      total += voice_leading::motion(voice_leading::fromNotes(chords[i - 1].notes),
+                                     voice_leading::fromNotes(chords[i].notes));
+    return total;
+  };
+
+  std::vector<voicing> greedy;
+  for (const Chord &chord : progression) greedy.push_back(voice_leading::fromNotes(chord.notes));
+  long greedyMotion = 0;
+  for (size_t i = 1; i < greedy.size(); i++)
+  {
+    baseline::greedyMatch(greedy[i], greedy[i - 1]);
+    greedyMotion += voice_leading::motion(greedy[i - 1], greedy[i]);
+  }
+  std::vector<Chord> chained = progression;
+  for (size_t i = 1; i < chained.size(); i++) chained[i].match(chained[i - 1]);
+  std::vector<Chord> led = progression;
+  double leading = nsPerCall(1, [&] { Chord::voiceLead(led.data(), led.size()); });
+  printf("voice leading, %zu random chords: greedy baseline %ld semitones, chained match %ld, voiceLead %ld in %.1f ms\n",
+         progression.size(), greedyMotion, motion(chained), motion(led), leading / 1e6);
+
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  // Checks, no audio device or window:
+  //   theory_demo --selftest
+  if (argc > 1 && std::string(argv[1]) == "--selftest")
+    return selfTest();
+
+  // Micro-benchmarks, no audio device or window:
+  //   theory_demo --bench
+  if (argc > 1 && std::string(argv[1]) == "--bench")
+    return bench();
+
   // Create app instance
   MyApp app;
 
+  // Offline render, no audio device or window:
+  //   theory_demo --render out.wav [seconds] [sampleRate] [blockSize] [keys]
+  if (argc > 2 && std::string(argv[1]) == "--render")
+  {
+    audio::render_settings settings;
+    settings.seconds = argc > 3 ? atof(argv[3]) : 14;
+    settings.sampleRate = argc > 4 ? atof(argv[4]) : 48000;
+    settings.blockSize = argc > 5 ? atoi(argv[5]) : 512;
+    return app.renderToFile(argv[2], settings, argc > 6 ? argv[6] : "m");
+  }
+
   // Set up audio
   app.configureAudio(48000., 512, 2, 0);
 